@@ -0,0 +1,119 @@
+// sqnice/bench/bench.hh
+//
+// The MIT License
+//
+// Copyright (c) 2024 Jens Alfke (Github: snej)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#pragma once
+#include "sqnice/sqnice.hh"
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+// A minimal benchmark harness: no dependencies, just timing loops that print ns/op.
+// Each bench_*.cc file registers its benchmarks with `BENCHMARK(name) { ... }`;
+// `sqnice_bench [substring...]` runs all of them, or just those whose names match.
+
+namespace sqnice_bench {
+    using clock = std::chrono::steady_clock;
+
+    /// Prevents the optimizer from discarding a computed value.
+    template <class T>
+    inline void keep(T const& value) {
+#if defined(__GNUC__) || defined(__clang__)
+        asm volatile("" : : "g"(&value) : "memory");
+#else
+        static const void* volatile sink;
+        sink = &value;
+#endif
+    }
+
+    /// Prints a time per operation in nanoseconds.
+    inline void print_time(const char* label, double ns) {
+        std::printf("    %-52s %10.1f ns/op\n", label, ns);
+    }
+
+    /// Calls `fn` `iterations` times (after a brief warmup), then prints and returns the
+    /// average time per call in nanoseconds.
+    template <class FN>
+    double measure(const char* label, size_t iterations, FN&& fn) {
+        for (size_t i = 0; i < iterations / 10; ++i)
+            fn();
+        auto start = clock::now();
+        for (size_t i = 0; i < iterations; ++i)
+            fn();
+        std::chrono::duration<double, std::nano> elapsed = clock::now() - start;
+        double ns = elapsed.count() / double(iterations);
+        print_time(label, ns);
+        return ns;
+    }
+
+    /// Runs `fn` `per_thread` times on each of `n_threads` threads, and returns the mean latency
+    /// of one call in nanoseconds.
+    template <class FN>
+    double per_thread_latency(unsigned n_threads, size_t per_thread, FN fn) {
+        std::vector<std::thread> threads;
+        std::vector<double> elapsed(n_threads);
+        for (unsigned t = 0; t < n_threads; ++t) {
+            threads.emplace_back([&, t] {
+                auto start = clock::now();
+                for (size_t i = 0; i < per_thread; ++i)
+                    fn();
+                elapsed[t] = std::chrono::duration<double, std::nano>(clock::now() - start).count();
+            });
+        }
+        double total = 0;
+        for (unsigned t = 0; t < n_threads; ++t) {
+            threads[t].join();
+            total += elapsed[t];
+        }
+        return total / double(n_threads * per_thread);
+    }
+
+    /// Prints how much slower `ns` is than `baseline_ns`.
+    inline void print_overhead(const char* label, double ns, double baseline_ns) {
+        std::printf("    %-52s %10.2fx\n", label, ns / baseline_ns);
+    }
+
+    /// Prints a throughput in items per second, given the time per item in nanoseconds.
+    inline void print_rate(const char* label, double ns_per_item, const char* unit = "rows") {
+        std::printf("    %-52s %10.0f %s/s\n", label, 1e9 / ns_per_item, unit);
+    }
+
+    /// Opens a new temporary database configured for benchmarking.
+    inline sqnice::database temp_database() {
+        sqnice::database db;
+        db.open_temporary(true);
+        db.setup();
+        return db;
+    }
+
+    /// A registered benchmark. (Use the `BENCHMARK` macro instead of this directly.)
+    struct benchmark {
+        benchmark(const char* name, void (*fn)());
+    };
+}
+
+#define BENCHMARK(NAME) \
+    static void bench_##NAME(); \
+    static sqnice_bench::benchmark bench_reg_##NAME(#NAME, &bench_##NAME); \
+    static void bench_##NAME()
@@ -0,0 +1,393 @@
+// sqnice/bench/bench_api.cc
+//
+// The MIT License
+//
+// Copyright (c) 2024 Jens Alfke (Github: snej)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include "bench.hh"
+#include <sqlite3.h>
+#include <condition_variable>
+#include <filesystem>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+// Benchmarks of the wrapper's hot paths, each compared against the equivalent raw
+// `sqlite3_*` calls on the same connection, so the wrapper's overhead is visible.
+
+using namespace std;
+using namespace sqnice_bench;
+
+static constexpr const char* kLookupSQL = "SELECT id, name FROM items WHERE id = ?1";
+
+static sqnice::database items_database(int64_t rows) {
+    sqnice::database db = temp_database();
+    db.execute("CREATE TABLE items (id INTEGER PRIMARY KEY, name TEXT, data BLOB)");
+    sqnice::command ins(db, "INSERT INTO items (id, name, data) VALUES (?, ?, zeroblob(16))");
+    sqnice::transaction txn(db);
+    for (int64_t i = 0; i < rows; ++i)
+        ins.execute(i, "item number " + to_string(i));
+    txn.commit();
+    return db;
+}
+
+
+// Compiling a statement from scratch vs. getting it from the database's statement cache.
+BENCHMARK(api_prepare) {
+    sqnice::database db = items_database(1);
+    sqlite3* raw = db.handle();
+
+    constexpr size_t N = 200'000;
+    double raw_ns = measure("raw: sqlite3_prepare_v3 + finalize", N, [&] {
+        sqlite3_stmt* stmt;
+        sqlite3_prepare_v3(raw, kLookupSQL, -1, 0, &stmt, nullptr);
+        sqlite3_finalize(stmt);
+    });
+    double prep_ns = measure("query(db, sql) -- compiles", N, [&] {
+        sqnice::query q(db, kLookupSQL);
+        keep(q);
+    });
+    double cached_ns = measure("db.query(sql) -- cached", N, [&] {
+        sqnice::query q = db.query(kLookupSQL);
+        keep(q);
+    });
+    print_overhead("query(db, sql) vs. raw", prep_ns, raw_ns);
+    print_overhead("raw prepare vs. db.query(sql)", raw_ns, cached_ns);
+
+    constexpr size_t M = 1'000'000;
+    sqlite3_stmt* stmt;
+    sqlite3_prepare_v3(raw, kLookupSQL, -1, SQLITE_PREPARE_PERSISTENT, &stmt, nullptr);
+    raw_ns = measure("raw: reused stmt, bind + step + column + reset", M, [&] {
+        sqlite3_bind_int64(stmt, 1, 0);
+        sqlite3_step(stmt);
+        auto name = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
+        keep(name);
+        sqlite3_reset(stmt);
+    });
+    sqlite3_finalize(stmt);
+    cached_ns = measure("db.query(sql)(id) + column", M, [&] {
+        auto q = db.query(kLookupSQL)(0);
+        auto name = q.begin()->get<string_view>(1);
+        keep(name);
+    });
+    print_overhead("db.query(sql) vs. raw reused stmt", cached_ns, raw_ns);
+}
+
+
+// Binding four parameters by position and by name.
+BENCHMARK(api_binding) {
+    sqnice::database db = temp_database();
+    db.execute("CREATE TABLE items (a INTEGER, b INTEGER, c INTEGER, d INTEGER)");
+    sqnice::command cmd(db, "INSERT INTO items (a, b, c, d) "
+                            "VALUES (:alpha, :beta, :gamma, :delta)");
+    sqlite3_stmt* stmt;
+    sqlite3_prepare_v3(db.handle(), "INSERT INTO items (a, b, c, d) "
+                       "VALUES (:alpha, :beta, :gamma, :delta)", -1, 0, &stmt, nullptr);
+
+    constexpr size_t N = 2'000'000;
+    double raw_pos_ns = measure("raw: sqlite3_bind_int x4", N, [&] {
+        sqlite3_bind_int(stmt, 1, 1);
+        sqlite3_bind_int(stmt, 2, 2);
+        sqlite3_bind_int(stmt, 3, 3);
+        sqlite3_bind_int(stmt, 4, 4);
+    });
+    double pos_ns = measure("bind(idx, v) x4", N, [&] {
+        cmd.bind(1, 1);
+        cmd.bind(2, 2);
+        cmd.bind(3, 3);
+        cmd.bind(4, 4);
+    });
+    double raw_name_ns = measure("raw: sqlite3_bind_parameter_index + bind x4", N, [&] {
+        sqlite3_bind_int(stmt, sqlite3_bind_parameter_index(stmt, ":alpha"), 1);
+        sqlite3_bind_int(stmt, sqlite3_bind_parameter_index(stmt, ":beta"), 2);
+        sqlite3_bind_int(stmt, sqlite3_bind_parameter_index(stmt, ":gamma"), 3);
+        sqlite3_bind_int(stmt, sqlite3_bind_parameter_index(stmt, ":delta"), 4);
+    });
+    double name_ns = measure("bind(\":name\", v) x4", N, [&] {
+        cmd.bind(":alpha", 1);
+        cmd.bind(":beta", 2);
+        cmd.bind(":gamma", 3);
+        cmd.bind(":delta", 4);
+    });
+    sqlite3_finalize(stmt);
+    print_overhead("positional vs. raw", pos_ns, raw_pos_ns);
+    print_overhead("named vs. raw", name_ns, raw_name_ns);
+}
+
+
+// Inserts `n` rows into a new database, with `command::execute` or raw calls, in autocommit
+// mode or in one transaction. (Each run gets its own database, so that WAL checkpoints
+// triggered by one run don't slow down the next.)
+static double measure_inserts(const char* label, size_t n, bool raw, bool in_transaction) {
+    sqnice::database db = temp_database();
+    db.execute("CREATE TABLE items (id INTEGER PRIMARY KEY, name TEXT)");
+    constexpr const char* kInsertSQL = "INSERT INTO items (id, name) VALUES (?, ?)";
+    sqnice::command cmd(db, kInsertSQL);
+    sqlite3_stmt* stmt;
+    sqlite3_prepare_v3(db.handle(), kInsertSQL, -1, SQLITE_PREPARE_PERSISTENT, &stmt, nullptr);
+    int64_t id = 0;
+    std::optional<sqnice::transaction> txn;
+    if (in_transaction)
+        txn.emplace(db);
+    double ns;
+    if (raw) {
+        ns = measure(label, n, [&] {
+            sqlite3_bind_int64(stmt, 1, ++id);
+            sqlite3_bind_text(stmt, 2, "some name", -1, SQLITE_STATIC);
+            sqlite3_step(stmt);
+            sqlite3_reset(stmt);
+        });
+    } else {
+        ns = measure(label, n, [&] {
+            cmd.execute(++id, sqnice::uncopied_string("some name"));
+        });
+    }
+    if (txn)
+        txn->commit();
+    sqlite3_finalize(stmt);
+    return ns;
+}
+
+// `command::execute` inserting rows, with and without an enclosing transaction.
+BENCHMARK(api_insert) {
+    constexpr size_t N = 20'000;
+    double raw_ns = measure_inserts("raw: insert, autocommit", N, true, false);
+    double ns = measure_inserts("execute(), autocommit", N, false, false);
+    print_overhead("autocommit: execute() vs. raw", ns, raw_ns);
+
+    constexpr size_t M = 1'000'000;
+    raw_ns = measure_inserts("raw: insert, in transaction", M, true, true);
+    ns = measure_inserts("execute(), in transaction", M, false, true);
+    print_rate("raw in transaction", raw_ns);
+    print_rate("execute() in transaction", ns);
+    print_overhead("in transaction: execute() vs. raw", ns, raw_ns);
+}
+
+
+// Reading text and blob columns as the various `column_value` types.
+BENCHMARK(api_column_value) {
+    sqnice::database db = items_database(1);
+    const char* kSQL = "SELECT name, data FROM items WHERE id = 0";
+    sqlite3_stmt* stmt;
+    sqlite3_prepare_v3(db.handle(), kSQL, -1, 0, &stmt, nullptr);
+    sqlite3_step(stmt);
+    sqnice::query q(db, kSQL);
+    auto i = q.begin();
+    auto row = *i;
+
+    constexpr size_t N = 10'000'000;
+    double raw_sv_ns = measure("raw: column_text + column_bytes", N, [&] {
+        string_view s(reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0)),
+                      size_t(sqlite3_column_bytes(stmt, 0)));
+        keep(s);
+    });
+    double sv_ns = measure("get<string_view>()", N, [&] {
+        auto s = row[0].get<string_view>();
+        keep(s);
+    });
+    double raw_str_ns = measure("raw: column_text + column_bytes -> string", N, [&] {
+        string s(reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0)),
+                 size_t(sqlite3_column_bytes(stmt, 0)));
+        keep(s);
+    });
+    double str_ns = measure("get<string>()", N, [&] {
+        auto s = row[0].get<string>();
+        keep(s);
+    });
+    double raw_blob_ns = measure("raw: column_blob + column_bytes", N, [&] {
+        span<const byte> b(static_cast<const byte*>(sqlite3_column_blob(stmt, 1)),
+                           size_t(sqlite3_column_bytes(stmt, 1)));
+        keep(b);
+    });
+    double blob_ns = measure("get<span<const byte>>()", N, [&] {
+        auto b = row[1].get<span<const byte>>();
+        keep(b);
+    });
+    sqlite3_finalize(stmt);
+    print_overhead("string_view vs. raw", sv_ns, raw_sv_ns);
+    print_overhead("string vs. raw", str_ns, raw_str_ns);
+    print_overhead("blob vs. raw", blob_ns, raw_blob_ns);
+}
+
+
+static void raw_plus_one(sqlite3_context* ctx, int, sqlite3_value** argv) {
+    sqlite3_result_int64(ctx, sqlite3_value_int64(argv[0]) + 1);
+}
+
+// The cost of calling a SQL function registered with `create_function`, per call.
+BENCHMARK(api_function_call) {
+    constexpr int64_t kRows = 200'000;
+    sqnice::database db = items_database(kRows);
+    sqlite3_create_function_v2(db.handle(), "raw_plus_one", 1,
+                               SQLITE_UTF8 | SQLITE_DETERMINISTIC, nullptr,
+                               &raw_plus_one, nullptr, nullptr, nullptr);
+    auto flags = sqnice::function_flags::deterministic;
+    db.create_function<int64_t (int64_t)>("typed_plus_one", [](int64_t i) {return i + 1;},
+                                          flags);
+    db.create_function("handler_plus_one",
+                       [](sqnice::function_args args, sqnice::function_result result) {
+                           int64_t i = args[0];
+                           result = i + 1;
+                       }, 1, flags);
+
+    auto run = [&](const char* label, const char* expr) {
+        sqnice::query q(db, "SELECT sum(" + string(expr) + ") FROM items");
+        return measure(label, 10, [&] {
+            keep(q.single_value<int64_t>());
+        }) / kRows;
+    };
+    double base_ns = run("no function: id+1, per scan", "id + 1");
+    double raw_ns = run("raw sqlite3_create_function_v2, per scan", "raw_plus_one(id)");
+    double typed_ns = run("create_function<int64_t(int64_t)>, per scan", "typed_plus_one(id)");
+    double handler_ns = run("create_function(function_handler), per scan", "handler_plus_one(id)");
+    printf("    %-52s %10.1f ns/call\n", "raw call overhead", raw_ns - base_ns);
+    printf("    %-52s %10.1f ns/call\n", "typed call overhead", typed_ns - base_ns);
+    printf("    %-52s %10.1f ns/call\n", "function_handler call overhead", handler_ns - base_ns);
+}
+
+
+// Random-access reads and writes of a blob through `blob_stream`.
+BENCHMARK(api_blob_stream) {
+    constexpr int kBlobSize = 1 << 20, kChunk = 4096;
+    sqnice::database db = temp_database();
+    db.execute("CREATE TABLE blobs (id INTEGER PRIMARY KEY, data BLOB)");
+    db.execute("INSERT INTO blobs (id, data) VALUES (1, zeroblob(" + to_string(kBlobSize) + "))");
+    sqlite3_blob* raw;
+    sqlite3_blob_open(db.handle(), "main", "blobs", "data", 1, 1, &raw);
+    sqnice::blob_stream stream(db, "blobs", "data", 1, true);
+
+    char buf[kChunk] = {};
+    uint64_t offset = 0;
+    auto next_offset = [&] {
+        offset = (offset + 7 * kChunk) % kBlobSize;
+        return offset;
+    };
+    constexpr size_t N = 1'000'000;
+    double raw_read_ns = measure("raw: sqlite3_blob_read 4KB", N, [&] {
+        sqlite3_blob_read(raw, buf, kChunk, int(next_offset()));
+        keep(buf);
+    });
+    double read_ns = measure("blob_stream::pread 4KB", N, [&] {
+        keep(stream.pread(buf, kChunk, next_offset()));
+    });
+    double raw_write_ns = measure("raw: sqlite3_blob_write 4KB", N, [&] {
+        sqlite3_blob_write(raw, buf, kChunk, int(next_offset()));
+    });
+    double write_ns = measure("blob_stream::pwrite 4KB", N, [&] {
+        keep(stream.pwrite(buf, kChunk, next_offset()));
+    });
+    sqlite3_blob_close(raw);
+    print_overhead("pread vs. raw", read_ns, raw_read_ns);
+    print_overhead("pwrite vs. raw", write_ns, raw_write_ns);
+}
+
+
+// `pool::borrow` latency as threads contend for its connections. The raw baseline is the
+// least a pool can do: a mutex-protected stack of `sqlite3*` handles with a condition variable.
+BENCHMARK(api_pool_borrow) {
+    auto path = filesystem::temp_directory_path() / "sqnice_bench_pool.sqlite3";
+    sqnice::pool pool(path.string(),
+                      sqnice::open_flags::delete_first | sqnice::open_flags::readwrite
+                      | sqnice::open_flags::create);
+    pool.borrow_writeable()->execute("CREATE TABLE IF NOT EXISTS items (id INTEGER)");
+    unsigned readers = pool.capacity() - 1;
+
+    mutex mut;
+    condition_variable cond;
+    vector<sqlite3*> handles;
+    for (unsigned i = 0; i < readers; ++i) {
+        sqlite3* h;
+        sqlite3_open_v2(path.string().c_str(), &h, SQLITE_OPEN_READONLY, nullptr);
+        handles.push_back(h);
+    }
+    vector<sqlite3*> all_handles = handles;
+    auto raw_borrow = [&] {
+        unique_lock lock(mut);
+        cond.wait(lock, [&] {return !handles.empty();});
+        sqlite3* h = handles.back();
+        handles.pop_back();
+        lock.unlock();
+        keep(h);
+        lock.lock();
+        handles.push_back(h);
+        cond.notify_one();
+    };
+    auto borrow = [&] {
+        auto db = pool.borrow();
+        keep(db);
+    };
+
+    printf("    (%u read-only connections, %u CPUs)\n", readers, thread::hardware_concurrency());
+    constexpr size_t N = 200'000;
+    for (unsigned n_threads : {1u, 2u, 4u, 8u, 16u}) {
+        char label[64];
+        snprintf(label, sizeof(label), "raw: mutex + handle stack, %2u threads", n_threads);
+        double raw_ns = per_thread_latency(n_threads, N / n_threads, raw_borrow);
+        print_time(label, raw_ns);
+        snprintf(label, sizeof(label), "pool.borrow(), %2u threads", n_threads);
+        double ns = per_thread_latency(n_threads, N / n_threads, borrow);
+        print_time(label, ns);
+        print_overhead("borrow() vs. raw", ns, raw_ns);
+    }
+    for (sqlite3* h : all_handles)
+        sqlite3_close_v2(h);
+    pool.close_all();
+    filesystem::remove(path);
+}
+
+
+// Many reader threads each borrowing a database and running a cached query, with and without
+// the pool's thread affinity. The pool has one read-only connection per thread.
+BENCHMARK(pool_affinity) {
+    auto path = filesystem::temp_directory_path() / "sqnice_bench_pool.sqlite3";
+    printf("    (%u CPUs)\n", thread::hardware_concurrency());
+    for (unsigned n_threads : {1u, 4u, 16u, 32u, 64u}) {
+        double ns[2];
+        for (int affinity = 0; affinity <= 1; ++affinity) {
+            sqnice::pool pool(path.string(),
+                              sqnice::open_flags::delete_first | sqnice::open_flags::readwrite
+                              | sqnice::open_flags::create);
+            {
+                auto db = pool.borrow_writeable();
+                db->execute("CREATE TABLE items (id INTEGER PRIMARY KEY, name TEXT)");
+                db->execute("INSERT INTO items (id, name) VALUES (1, 'one')");
+            }
+            pool.set_capacity(n_threads + 1);
+            pool.set_thread_affinity(affinity);
+            constexpr size_t N = 400'000;
+            ns[affinity] = per_thread_latency(n_threads, N / n_threads, [&] {
+                auto db = pool.borrow();
+                keep(db->query(kLookupSQL)(1).single_value<int64_t>());
+            });
+            char label[64];
+            snprintf(label, sizeof(label), "borrow() + query, %2u threads, affinity %s",
+                     n_threads, (affinity ? "on" : "off"));
+            print_time(label, ns[affinity]);
+            pool.close_all();
+        }
+        print_overhead("affinity off vs. on", ns[0], ns[1]);
+    }
+    filesystem::remove(path);
+}
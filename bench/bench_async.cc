@@ -0,0 +1,145 @@
+// sqnice/bench/bench_async.cc
+//
+// The MIT License
+//
+// Copyright (c) 2024 Jens Alfke (Github: snej)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#include "bench.hh"
+#include <atomic>
+#include <coroutine>
+#include <filesystem>
+#include <future>
+#include <latch>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+using namespace std;
+using namespace sqnice_bench;
+
+static constexpr unsigned kClients       = 256;     // Concurrent requests in flight
+static constexpr unsigned kPerClient     = 200;     // Queries issued by each client
+static constexpr unsigned kQueries       = kClients * kPerClient;
+static constexpr int64_t  kRows          = 10'000;
+
+static constexpr const char* kLookupSQL  = "SELECT name FROM items WHERE id = ?";
+
+// Creates a pool on a fresh database file populated with `kRows` rows.
+static void populate(sqnice::pool& pool) {
+    auto db = pool.borrow_writeable();
+    db->execute("CREATE TABLE items (id INTEGER PRIMARY KEY, name TEXT)");
+    sqnice::bulk_inserter<int64_t, string> ins(*db, "items", {"id", "name"});
+    sqnice::transaction txn(*db);
+    for (int64_t i = 0; i < kRows; ++i)
+        ins.insert(i, "item number " + to_string(i));
+    ins.flush();
+    txn.commit();
+}
+
+static int64_t key_for(unsigned client, unsigned i) {
+    return int64_t(client * 7919 + i * 104729) % kRows;
+}
+
+
+namespace {
+    // Fire-and-forget coroutine type.
+    struct detached_task {
+        struct promise_type {
+            detached_task get_return_object() noexcept              {return {};}
+            std::suspend_never initial_suspend() noexcept           {return {};}
+            std::suspend_never final_suspend() noexcept             {return {};}
+            void return_void() noexcept                             { }
+            void unhandled_exception() noexcept                     {std::terminate();}
+        };
+    };
+
+    detached_task coroutine_client(sqnice::pool& pool, unsigned client,
+                                   atomic<size_t>& total, latch& done) {
+        for (unsigned i = 0; i < kPerClient; ++i) {
+            sqnice::borrowed_database db = co_await pool.borrow_async();
+            auto name = db->query(kLookupSQL)(key_for(client, i)).single_value_or<string>("");
+            total += name.size();
+        }
+        done.count_down();
+    }
+}
+
+
+// Compares `kClients` concurrent clients sharing a pool, each running `kPerClient` lookups:
+// one thread per client blocking in `borrow()`, vs. futures from `async_query`, vs. coroutines
+// suspended in `co_await borrow_async()`.
+BENCHMARK(async_pool) {
+    auto path = filesystem::temp_directory_path() / "sqnice_bench_async.sqlite3";
+    sqnice::pool pool(path.string(),
+                      sqnice::open_flags::delete_first | sqnice::open_flags::readwrite);
+    populate(pool);
+    printf("    (%u clients, %u queries, %u read-only connections, %u CPUs)\n",
+           kClients, kQueries, pool.capacity() - 1, thread::hardware_concurrency());
+
+    constexpr size_t N = 3;
+    double blocking_ns = measure("blocking borrow(), thread per client", N, [&] {
+        atomic<size_t> total = 0;
+        vector<thread> threads;
+        for (unsigned c = 0; c < kClients; ++c) {
+            threads.emplace_back([&, c] {
+                for (unsigned i = 0; i < kPerClient; ++i) {
+                    auto db = pool.borrow();
+                    auto name = db->query(kLookupSQL)(key_for(c, i)).single_value_or<string>("");
+                    total += name.size();
+                }
+            });
+        }
+        for (auto& t : threads)
+            t.join();
+        keep(total);
+    }) / kQueries;
+    double future_ns = measure("async_query() futures, one calling thread", N, [&] {
+        size_t total = 0;
+        vector<future<vector<tuple<string>>>> inflight;
+        inflight.reserve(kClients);
+        for (unsigned i = 0; i < kPerClient; ++i) {
+            for (unsigned c = 0; c < kClients; ++c)
+                inflight.push_back(pool.async_query<string>(kLookupSQL, key_for(c, i)));
+            for (auto& f : inflight)
+                total += std::get<0>(f.get().at(0)).size();
+            inflight.clear();
+        }
+        keep(total);
+    }) / kQueries;
+    double coro_ns = measure("co_await borrow_async(), coroutine per client", N, [&] {
+        atomic<size_t> total = 0;
+        latch done(kClients);
+        for (unsigned c = 0; c < kClients; ++c)
+            coroutine_client(pool, c, total, done);
+        done.wait();
+        keep(total);
+    }) / kQueries;
+
+    print_rate("blocking borrow() throughput", blocking_ns, "queries");
+    print_rate("async_query() throughput", future_ns, "queries");
+    print_rate("borrow_async() throughput", coro_ns, "queries");
+    print_overhead("blocking / async_query", blocking_ns, future_ns);
+    print_overhead("blocking / borrow_async", blocking_ns, coro_ns);
+    pool.close_all();
+    filesystem::remove(path);
+}
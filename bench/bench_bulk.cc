@@ -0,0 +1,166 @@
+// sqnice/bench/bench_bulk.cc
+//
+// The MIT License
+//
+// Copyright (c) 2024 Jens Alfke (Github: snej)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#include "bench.hh"
+#include <filesystem>
+#include <future>
+#include <string>
+#include <tuple>
+#include <vector>
+
+using namespace std;
+using namespace sqnice_bench;
+
+static constexpr size_t kBatchSize = 1000;
+static constexpr string_view kInsertSQL = "INSERT INTO items (a, b, c) VALUES (?, ?, ?)";
+
+static vector<tuple<int64_t, string, double>> make_rows() {
+    vector<tuple<int64_t, string, double>> rows;
+    rows.reserve(kBatchSize);
+    for (size_t i = 0; i < kBatchSize; ++i)
+        rows.emplace_back(int64_t(i), "item number " + to_string(i), i * 0.5);
+    return rows;
+}
+
+// Compares inserting rows with `execute` in a loop vs. `execute_many`.
+BENCHMARK(execute_many) {
+    sqnice::database db = temp_database();
+    db.execute("CREATE TABLE items (a INTEGER, b TEXT, c REAL)");
+    auto rows = make_rows();
+
+    constexpr size_t N = 500;
+    double loop_ns = measure("execute() loop in a transaction, per batch", N, [&] {
+        sqnice::transaction txn(db);
+        sqnice::command cmd = db.command(kInsertSQL);
+        for (auto& [a, b, c] : rows)
+            cmd.execute(a, b, c);
+        txn.commit();
+    }) / kBatchSize;
+    db.execute("DELETE FROM items");
+
+    double many_ns = measure("execute_many(), per batch", N, [&] {
+        db.cached_command(kInsertSQL).execute_many(rows);
+    }) / kBatchSize;
+
+    print_rate("execute() loop", loop_ns);
+    print_rate("execute_many()", many_ns);
+    print_overhead("loop vs. execute_many", loop_ns, many_ns);
+}
+
+
+// Compares `execute_many` with `bulk_inserter`'s multi-row INSERT statements.
+BENCHMARK(bulk_insert) {
+    sqnice::database db = temp_database();
+    db.execute("CREATE TABLE items (a INTEGER, b TEXT, c REAL)");
+    auto rows = make_rows();
+
+    constexpr size_t N = 500;
+    double many_ns = measure("execute_many(), per batch", N, [&] {
+        db.cached_command(kInsertSQL).execute_many(rows);
+    }) / kBatchSize;
+    db.execute("DELETE FROM items");
+
+    sqnice::bulk_inserter<int64_t, string, double> ins(db, "items", {"a", "b", "c"});
+    double bulk_ns = measure("bulk_inserter, per batch", N, [&] {
+        sqnice::transaction txn(db);
+        ins.insert_all(rows);
+        ins.flush();
+        txn.commit();
+    }) / kBatchSize;
+
+    print_rate("execute_many()", many_ns);
+    print_rate("bulk_inserter", bulk_ns);
+    std::printf("    %-52s %10zu\n", "bulk_inserter rows per statement", ins.rows_per_chunk());
+    std::printf("    %-52s %10.0f rows/s\n", "bulk_inserter stats (bind + execute only)",
+                ins.stats().rows_per_second());
+    print_overhead("execute_many vs. bulk_inserter", many_ns, bulk_ns);
+}
+
+
+// Many threads each committing a one-row insert, with `transaction(pool)` vs. `group_commit`.
+// The database uses WAL with `synchronous=FULL`, so every commit syncs to disk.
+BENCHMARK(group_commit) {
+    auto path = filesystem::temp_directory_path() / "sqnice_bench_group.sqlite3";
+    for (unsigned n_threads : {1u, 4u, 16u, 64u}) {
+        double ns[2];
+        for (int grouped = 0; grouped <= 1; ++grouped) {
+            sqnice::pool pool(path.string(),
+                              sqnice::open_flags::delete_first | sqnice::open_flags::readwrite
+                              | sqnice::open_flags::create);
+            pool.on_open([](sqnice::database& db) {
+                db.execute("PRAGMA journal_mode=WAL; PRAGMA synchronous=FULL");
+            });
+            pool.borrow_writeable()->execute("CREATE TABLE items (a INTEGER, b TEXT, c REAL)");
+            auto insert = [](sqnice::database& db) {
+                db.cached_command(kInsertSQL).execute(1, "item", 0.5);
+            };
+            size_t per_thread = max(size_t(4), size_t(2000) / n_threads);
+            double latency = per_thread_latency(n_threads, per_thread, [&] {
+                if (grouped) {
+                    pool.group_commit(insert);
+                } else {
+                    sqnice::transaction txn(pool);
+                    insert(txn.active_database());
+                    txn.commit();
+                }
+            });
+            ns[grouped] = latency / n_threads;      // time per commit, across all threads
+            char label[64];
+            snprintf(label, sizeof(label), "%-17s %2u threads",
+                     (grouped ? "group_commit()" : "transaction(pool)"), n_threads);
+            print_rate(label, ns[grouped], "commits");
+            pool.close_all();
+        }
+        print_overhead("transaction vs. group_commit", ns[0], ns[1]);
+    }
+
+    // One thread pipelining writes to the pool's writer thread, without waiting for each:
+    {
+        sqnice::pool pool(path.string(),
+                          sqnice::open_flags::delete_first | sqnice::open_flags::readwrite
+                          | sqnice::open_flags::create);
+        pool.on_open([](sqnice::database& db) {
+            db.execute("PRAGMA journal_mode=WAL; PRAGMA synchronous=FULL");
+        });
+        pool.borrow_writeable()->execute("CREATE TABLE items (a INTEGER, b TEXT, c REAL)");
+        constexpr size_t N = 2000;
+        vector<future<void>> futures;
+        futures.reserve(N);
+        auto start = clock::now();
+        for (size_t i = 0; i < N; ++i) {
+            futures.push_back(pool.async_write([](sqnice::database& db) {
+                db.cached_command(kInsertSQL).execute(1, "item", 0.5);
+            }));
+        }
+        for (auto& f : futures)
+            f.get();
+        double ns = chrono::duration<double, nano>(clock::now() - start).count() / N;
+        print_rate("async_write(), 1 thread, pipelined", ns, "writes");
+        pool.close_all();
+    }
+    filesystem::remove(path);
+    filesystem::remove(path.string() + "-wal");
+    filesystem::remove(path.string() + "-shm");
+}
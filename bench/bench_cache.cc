@@ -0,0 +1,104 @@
+// sqnice/bench/bench_cache.cc
+//
+// The MIT License
+//
+// Copyright (c) 2024 Jens Alfke (Github: snej)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#include "bench.hh"
+#include <string>
+
+using namespace std;
+using namespace sqnice_bench;
+
+static constexpr string_view kSQL = "SELECT id, name FROM items WHERE id = ?1";
+
+// Compares the ways of getting a cached statement from a `database`.
+BENCHMARK(statement_lookup) {
+    sqnice::database db = temp_database();
+    db.execute("CREATE TABLE items (id INTEGER PRIMARY KEY, name TEXT)");
+    db.execute("INSERT INTO items (id, name) VALUES (1, 'one')");
+    // Fill the cache with other statements too, so the lookup isn't trivial:
+    for (int i = 0; i < 50; ++i)
+        (void)db.query("SELECT " + to_string(i));
+
+    constexpr size_t N = 2'000'000;
+    double copy_ns = measure("query() -- copy of cached statement", N, [&] {
+        sqnice::query q = db.query(kSQL);
+        keep(q);
+    });
+    double ref_ns = measure("cached_query() -- reference to cached statement", N, [&] {
+        sqnice::query& q = db.cached_query(kSQL);
+        keep(q);
+    });
+    double lit_ns = measure("query<SQL>() -- literal slot", N, [&] {
+        sqnice::query& q = db.query<"SELECT id, name FROM items WHERE id = ?1">();
+        keep(q);
+    });
+    print_overhead("copy vs. reference", copy_ns, ref_ns);
+    print_overhead("reference vs. literal slot", ref_ns, lit_ns);
+
+    constexpr size_t M = 500'000;
+    copy_ns = measure("query() + bind + step", M, [&] {
+        auto name = db.query(kSQL)(1).single_value<string>();
+        keep(name);
+    });
+    ref_ns = measure("cached_query() + bind + step", M, [&] {
+        auto name = db.cached_query(kSQL)(1).single_value<string>();
+        keep(name);
+    });
+    lit_ns = measure("query<SQL>() + bind + step", M, [&] {
+        auto name = db.query<"SELECT id, name FROM items WHERE id = ?1">(1)
+                            .single_value<string>();
+        keep(name);
+    });
+    print_overhead("copy vs. reference", copy_ns, ref_ns);
+    print_overhead("reference vs. literal slot", ref_ns, lit_ns);
+}
+
+
+// Compares binding parameters by name, by `parameter_names`, and by index.
+BENCHMARK(named_binding) {
+    sqnice::database db = temp_database();
+    db.execute("CREATE TABLE items (a INTEGER, b INTEGER, c INTEGER, d INTEGER)");
+    sqnice::command cmd(db, "INSERT INTO items (a, b, c, d) "
+                            "VALUES (:alpha, :beta, :gamma, :delta)");
+    static const sqnice::parameter_names kNames {":alpha", ":beta", ":gamma", ":delta"};
+
+    constexpr size_t N = 2'000'000;
+    double name_ns = measure("bind(\":name\", v) x4", N, [&] {
+        cmd.bind(":alpha", 1);
+        cmd.bind(":beta", 2);
+        cmd.bind(":gamma", 3);
+        cmd.bind(":delta", 4);
+    });
+    double plan_ns = measure("bind(parameter_names, v, v, v, v)", N, [&] {
+        cmd.bind(kNames, 1, 2, 3, 4);
+    });
+    double index_ns = measure("bind(idx, v) x4", N, [&] {
+        cmd.bind(1, 1);
+        cmd.bind(2, 2);
+        cmd.bind(3, 3);
+        cmd.bind(4, 4);
+    });
+    print_overhead("by name vs. parameter_names", name_ns, plan_ns);
+    print_overhead("parameter_names vs. by index", plan_ns, index_ns);
+}
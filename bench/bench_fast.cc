@@ -0,0 +1,73 @@
+// sqnice/bench/bench_fast.cc
+//
+// The MIT License
+//
+// Copyright (c) 2024 Jens Alfke (Github: snej)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#include "bench.hh"
+#include <sqlite3.h>
+
+using namespace std;
+using namespace sqnice_bench;
+
+static constexpr const char* kSelectSQL = "SELECT ?1 + 1";
+
+// Measures the wrapper overhead of bind + step + column + reset, vs. the raw C API.
+BENCHMARK(fast_handle) {
+    sqnice::database db = temp_database();
+    sqnice::query q(db, kSelectSQL);
+
+    constexpr size_t N = 5'000'000;
+    int64_t total = 0;
+
+    sqlite3_stmt* raw;
+    sqlite3_prepare_v3(db.handle(), kSelectSQL, -1, SQLITE_PREPARE_PERSISTENT, &raw, nullptr);
+    int64_t i = 0;
+    double raw_ns = measure("C API: bind + step + column + reset", N, [&] {
+        sqlite3_bind_int64(raw, 1, ++i);
+        sqlite3_step(raw);
+        total += sqlite3_column_int64(raw, 0);
+        sqlite3_reset(raw);
+    });
+    sqlite3_finalize(raw);
+
+    double fast_ns;
+    {
+        auto fast = q.fast();
+        fast_ns = measure("fast_handle: bind + step + column + reset", N, [&] {
+            fast.bind(1, ++i);
+            fast.step();
+            total += fast.column_int64(0);
+            fast.reset();
+        });
+    }
+    double query_ns = measure("query: bind + begin + get<int64_t>", N, [&] {
+        q.bind(1, ++i);
+        total += q.begin()->get<int64_t>(0);
+    });
+    keep(total);
+
+    print_overhead("fast_handle vs. C API", fast_ns, raw_ns);
+    print_overhead("query vs. C API", query_ns, raw_ns);
+    std::printf("    %-52s %10.1f ns\n", "fast_handle overhead per bind+step", fast_ns - raw_ns);
+    std::printf("    %-52s %10.1f ns\n", "query overhead per bind+step", query_ns - raw_ns);
+}
@@ -0,0 +1,68 @@
+// sqnice/bench/bench_main.cc
+//
+// The MIT License
+//
+// Copyright (c) 2024 Jens Alfke (Github: snej)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include "bench.hh"
+#include <cstring>
+#include <utility>
+#include <vector>
+
+namespace sqnice_bench {
+    using namespace std;
+
+    static vector<pair<const char*, void(*)()>>& registry() {
+        static vector<pair<const char*, void(*)()>> sBenchmarks;
+        return sBenchmarks;
+    }
+
+    benchmark::benchmark(const char* name, void (*fn)()) {
+        registry().emplace_back(name, fn);
+    }
+}
+
+
+int main(int argc, const char* argv[]) {
+    using namespace sqnice_bench;
+#ifndef NDEBUG
+    std::printf("WARNING: This is a debug build; timings will not be representative.\n\n");
+#endif
+    int ran = 0;
+    for (auto& [name, fn] : registry()) {
+        bool selected = (argc <= 1);
+        for (int i = 1; i < argc && !selected; ++i)
+            selected = (std::strstr(name, argv[i]) != nullptr);
+        if (selected) {
+            std::printf("%s:\n", name);
+            fn();
+            std::printf("\n");
+            ++ran;
+        }
+    }
+    if (ran == 0) {
+        std::fprintf(stderr, "No benchmarks match. Available benchmarks are:\n");
+        for (auto& [name, fn] : registry())
+            std::fprintf(stderr, "    %s\n", name);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,56 @@
+// sqnice/bench/bench_profile.cc
+//
+// The MIT License
+//
+// Copyright (c) 2024 Jens Alfke (Github: snej)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#include "bench.hh"
+#include <string>
+
+using namespace std;
+using namespace sqnice_bench;
+
+// Measures the overhead of profiling every statement, on a fast primary-key lookup.
+BENCHMARK(profiling) {
+    sqnice::database db = temp_database();
+    db.execute("CREATE TABLE items (id INTEGER PRIMARY KEY, name TEXT)");
+    db.execute("INSERT INTO items (id, name) VALUES (1, 'one')");
+    auto lookup = [&] {
+        auto name = db.query<"SELECT name FROM items WHERE id = ?1">(1).single_value<string>();
+        keep(name);
+    };
+
+    constexpr size_t N = 1'000'000;
+    double base_ns = measure("lookup, no profile handler", N, lookup);
+
+    db.set_profile_handler([](sqnice::statement_profile const& prof) {keep(prof.duration);});
+    double handler_ns = measure("lookup, empty profile handler", N, lookup);
+
+    sqnice::slow_query_log log(chrono::milliseconds(100));
+    log.attach(db);
+    double log_ns = measure("lookup, slow_query_log", N, lookup);
+    db.set_profile_handler(nullptr);
+
+    print_overhead("profile handler vs. none", handler_ns, base_ns);
+    print_overhead("slow_query_log vs. none", log_ns, base_ns);
+    printf("    %-52s %10.1f ns\n", "slow_query_log cost per statement", log_ns - base_ns);
+}
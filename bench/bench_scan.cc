@@ -0,0 +1,229 @@
+// sqnice/bench/bench_scan.cc
+//
+// The MIT License
+//
+// Copyright (c) 2024 Jens Alfke (Github: snej)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#include "bench.hh"
+#include <sqlite3.h>
+#include <memory_resource>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+using namespace std;
+using namespace sqnice_bench;
+
+static constexpr size_t kScanRows = 1'000'000;
+
+static sqnice::database scan_database() {
+    sqnice::database db = temp_database();
+    db.execute("CREATE TABLE items (id INTEGER PRIMARY KEY, name TEXT, score REAL)");
+    sqnice::bulk_inserter<int64_t, string, double> ins(db, "items", {"id", "name", "score"});
+    sqnice::transaction txn(db);
+    for (size_t i = 0; i < kScanRows; ++i)
+        ins.insert(int64_t(i), "item number " + to_string(i), i * 0.25);
+    ins.flush();
+    txn.commit();
+    return db;
+}
+
+// Compares ways of reading the columns of every row of a query.
+BENCHMARK(row_scan) {
+    sqnice::database db = scan_database();
+    sqnice::query q(db, "SELECT id, name, score FROM items");
+
+    constexpr size_t N = 5;
+    sqlite3_stmt* stmt;
+    sqlite3_prepare_v3(db.handle(), "SELECT id, name, score FROM items", -1, 0, &stmt, nullptr);
+    double raw_ns = measure("raw: sqlite3_step + sqlite3_column_* per scan", N, [&] {
+        double total = 0;
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            int64_t id = sqlite3_column_int64(stmt, 0);
+            auto name = sqlite3_column_text(stmt, 1);
+            size_t name_len = size_t(sqlite3_column_bytes(stmt, 1));
+            double score = sqlite3_column_double(stmt, 2);
+            keep(name);
+            total += id + name_len + score;
+        }
+        sqlite3_reset(stmt);
+        keep(total);
+    }) / kScanRows;
+    sqlite3_finalize(stmt);
+    double index_ns = measure("row[] per scan", N, [&] {
+        double total = 0;
+        for (auto row : q) {
+            int64_t id = row[0];
+            string_view name = row[1];
+            double score = row[2];
+            total += id + name.size() + score;
+        }
+        keep(total);
+    }) / kScanRows;
+    double get_ns = measure("row.get<T>() per scan", N, [&] {
+        double total = 0;
+        for (auto row : q)
+            total += row.get<int64_t>(0) + row.get<string_view>(1).size()
+                     + row.get<double>(2);
+        keep(total);
+    }) / kScanRows;
+    double getter_ns = measure("row.getter() >> (into std::string) per scan", N, [&] {
+        double total = 0;
+        int64_t id;
+        string name;
+        double score;
+        for (auto row : q) {
+            row.getter() >> id >> name >> score;
+            total += id + name.size() + score;
+        }
+        keep(total);
+    }) / kScanRows;
+    double as_ns = measure("as<int64_t, string_view, double>() per scan", N, [&] {
+        double total = 0;
+        for (auto [id, name, score] : q.as<int64_t, string_view, double>())
+            total += id + name.size() + score;
+        keep(total);
+    }) / kScanRows;
+
+    print_rate("raw", raw_ns);
+    print_rate("row[]", index_ns);
+    print_rate("row.get<T>()", get_ns);
+    print_rate("row.getter()", getter_ns);
+    print_rate("as<...>()", as_ns);
+    print_overhead("row[] vs. as<...>()", index_ns, as_ns);
+    print_overhead("getter() vs. as<...>()", getter_ns, as_ns);
+    print_overhead("as<...>() vs. raw", as_ns, raw_ns);
+}
+
+
+// Compares summing a column row-by-row with summing it from column batches.
+BENCHMARK(column_batch) {
+    sqnice::database db = scan_database();
+    sqnice::query q(db, "SELECT id, score FROM items");
+
+    constexpr size_t N = 5;
+    double rows_ns = measure("as<int64_t, double>() sum per scan", N, [&] {
+        double total = 0;
+        for (auto [id, score] : q.as<int64_t, double>())
+            total += id * score;
+        keep(total);
+    }) / kScanRows;
+
+    sqnice::column_batch batch;
+    double batch_ns = measure("fetch_columns(4096) sum per scan", N, [&] {
+        double total = 0;
+        auto iter = q.begin();
+        while (size_t n = iter.fetch_columns(batch, 4096)) {
+            auto ids = batch[0].integers();
+            auto scores = batch[1].doubles();
+            for (size_t i = 0; i < n; ++i)
+                total += ids[i] * scores[i];
+        }
+        keep(total);
+    }) / kScanRows;
+
+    print_rate("as<...>()", rows_ns);
+    print_rate("fetch_columns()", batch_ns);
+    print_overhead("as<...>() vs. fetch_columns()", rows_ns, batch_ns);
+}
+
+
+// Compares materializing a result set into heap-allocated strings vs. strings in an arena.
+BENCHMARK(arena_rows) {
+    sqnice::database db = scan_database();
+    sqnice::query q(db, "SELECT id, name FROM items");
+
+    constexpr size_t N = 5;
+    double heap_ns = measure("as<int64_t, std::string>() into vector", N, [&] {
+        vector<tuple<int64_t, string>> rows;
+        rows.reserve(kScanRows);
+        for (auto&& row : q.as<int64_t, string>())
+            rows.push_back(std::move(row));
+        keep(rows);
+    }) / kScanRows;
+
+    std::pmr::monotonic_buffer_resource arena(64 << 20);
+    double arena_ns = measure("as<int64_t, std::pmr::string>(arena) into vector", N, [&] {
+        {
+            std::pmr::vector<tuple<int64_t, std::pmr::string>> rows(&arena);
+            rows.reserve(kScanRows);
+            for (auto&& row : q.as<int64_t, std::pmr::string>(arena))
+                rows.push_back(std::move(row));
+            keep(rows);
+        }
+        arena.release();
+    }) / kScanRows;
+
+    print_rate("std::string", heap_ns);
+    print_rate("std::pmr::string in arena", arena_ns);
+    print_overhead("heap vs. arena", heap_ns, arena_ns);
+}
+
+
+// Simulates heavy per-row work, like serializing the row to JSON.
+static size_t process_row(int64_t id, string_view name, double score, string& out) {
+    out.clear();
+    out += "{\"id\":";
+    out += to_string(id);
+    out += ",\"name\":\"";
+    for (char c : name) {
+        if (c == '"' || c == '\\')
+            out += '\\';
+        out += c;
+    }
+    out += "\",\"score\":";
+    out += to_string(score);
+    out += '}';
+    size_t hash = 14695981039346656037ull;
+    for (char c : out)
+        hash = (hash ^ uint8_t(c)) * 1099511628211ull;
+    return hash;
+}
+
+// Compares iterating a query synchronously vs. with a `row_stream` prefetching on a helper
+// thread, when the consumer does significant work per row.
+BENCHMARK(row_stream) {
+    sqnice::database db = scan_database();
+    sqnice::query q(db, "SELECT id, name, score FROM items");
+    printf("    (%u CPUs)\n", thread::hardware_concurrency());
+
+    constexpr size_t N = 3;
+    string out;
+    double sync_ns = measure("as<int64_t, string, double>() + work per scan", N, [&] {
+        size_t total = 0;
+        for (auto&& [id, name, score] : q.as<int64_t, string, double>())
+            total += process_row(id, name, score, out);
+        keep(total);
+    }) / kScanRows;
+    double stream_ns = measure("row_stream<int64_t, string, double> + work per scan", N, [&] {
+        size_t total = 0;
+        for (auto& [id, name, score] : sqnice::row_stream<int64_t, string, double>(q))
+            total += process_row(id, name, score, out);
+        keep(total);
+    }) / kScanRows;
+
+    print_rate("as<...>()", sync_ns);
+    print_rate("row_stream", stream_ns);
+    print_overhead("as<...>() vs. row_stream", sync_ns, stream_ns);
+}
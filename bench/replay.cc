@@ -0,0 +1,114 @@
+// sqnice/bench/replay.cc
+//
+// The MIT License
+//
+// Copyright (c) 2024 Jens Alfke (Github: snej)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+// Replays a workload log recorded by `sqnice::workload_recorder` against a database file,
+// and compares the statement latencies with the recorded ones. Since replaying modifies the
+// database, run it on a copy of the database as it was when recording started.
+
+#include "sqnice/sqnice.hh"
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace std;
+
+static void usage(const char* argv0) {
+    fprintf(stderr,
+        "Usage: %s [options] LOG DATABASE\n"
+        "    --original-timing     Run statements at their recorded times, a thread per\n"
+        "                          connection (default: serially, as fast as possible)\n"
+        "    --pragma P            Run `PRAGMA P` on each connection first, e.g.\n"
+        "                          `--pragma cache_size=-65536`. May be repeated.\n"
+        "    --errors N            Print up to N failed statements (default 10)\n",
+        argv0);
+    exit(1);
+}
+
+static void print_latency(const char* label, sqnice::latency_histogram const& h) {
+    auto us = [](chrono::nanoseconds ns) {return double(ns.count()) / 1000.0;};
+    printf("    %-10s %10llu %10.1f %10.1f %10.1f %10.1f %10.1f\n",
+           label, (unsigned long long)h.count(), us(h.mean()),
+           us(h.percentile(0.50)), us(h.percentile(0.99)), us(h.percentile(0.999)),
+           us(h.max()));
+}
+
+int main(int argc, const char* argv[]) {
+    sqnice::replay_options options;
+    vector<string> pragmas;
+    unsigned max_errors = 10;
+    vector<const char*> paths;
+    for (int i = 1; i < argc; ++i) {
+        string_view arg = argv[i];
+        if (arg == "--original-timing") {
+            options.original_timing = true;
+        } else if (arg == "--pragma" && i + 1 < argc) {
+            pragmas.push_back(argv[++i]);
+        } else if (arg == "--errors" && i + 1 < argc) {
+            max_errors = unsigned(atoi(argv[++i]));
+        } else if (arg.starts_with("-")) {
+            usage(argv[0]);
+        } else {
+            paths.push_back(argv[i]);
+        }
+    }
+    if (paths.size() != 2)
+        usage(argv[0]);
+
+    options.on_open = [&](sqnice::database& db) {
+        for (auto& pragma : pragmas)
+            db.execute("PRAGMA " + pragma);
+    };
+    sqnice::latency_histogram recorded, replayed;
+    unsigned errors_printed = 0;
+    options.on_statement = [&](sqnice::workload_event const& event, chrono::nanoseconds time,
+                               sqnice::status rc) {
+        recorded.record(event.duration);
+        replayed.record(time);
+        if (!ok(rc) && errors_printed++ < max_errors)
+            fprintf(stderr, "error %d on connection %u: %.*s\n", int(rc), event.connection,
+                    int(event.sql.size()), event.sql.data());
+    };
+
+    try {
+        auto result = sqnice::replay_workload(paths[0], paths[1], options);
+        printf("Replayed %llu statements (%llu failed) in %.3f sec, %s\n",
+               (unsigned long long)result.statements, (unsigned long long)result.errors,
+               chrono::duration<double>(result.elapsed).count(),
+               options.original_timing ? "with original timing" : "as fast as possible");
+        if (result.skipped)
+            printf("Skipped %llu statements whose parameters weren't recorded\n",
+                   (unsigned long long)result.skipped);
+        printf("    %-10s %10s %10s %10s %10s %10s %10s   (usec)\n",
+               "", "count", "mean", "p50", "p99", "p999", "max");
+        print_latency("recorded", recorded);
+        print_latency("replayed", replayed);
+        return result.errors ? 2 : 0;
+    } catch (std::exception const& x) {
+        fprintf(stderr, "%s\n", x.what());
+        return 1;
+    }
+}
@@ -0,0 +1,490 @@
+// sqnice/bench/ycsb.cc
+//
+// The MIT License
+//
+// Copyright (c) 2024 Jens Alfke (Github: snej)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+// A YCSB-style macro benchmark: loads a table of records, then runs the standard YCSB core
+// workloads A-F against a `sqnice::pool` from several threads, and reports throughput and
+// latency percentiles. Everything is local; there's no client/server.
+//
+// Workloads (from YCSB's `workloads/` directory):
+//   A  update heavy       50% read, 50% update                zipfian
+//   B  read mostly        95% read,  5% update                zipfian
+//   C  read only         100% read                            zipfian
+//   D  read latest        95% read,  5% insert                latest
+//   E  short ranges       95% scan,  5% insert                zipfian, scans of 1-100 rows
+//   F  read-modify-write  50% read, 50% read-modify-write     zipfian
+//
+// Each workload starts from a freshly loaded database, so their results are independent.
+// Writes go through the pool's single writeable connection; with `--batch N` each thread
+// groups N consecutive writes into one transaction, and a write's latency runs until its
+// transaction commits. A record being inserted by one thread may be chosen for reading by
+// another before the insert commits; such reads are reported as "not found".
+
+#include "sqnice/sqnice.hh"
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <random>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+using namespace std;
+using clock_type = chrono::steady_clock;
+
+
+#pragma mark - OPTIONS:
+
+
+struct options {
+    string      workloads   = "ABCDEF";
+    unsigned    threads     = 4;
+    uint64_t    records     = 100'000;
+    uint64_t    operations  = 200'000;      // per workload, across all threads
+    string      journal     = "wal";
+    int64_t     cache_kb    = 2000;         // SQLite's default
+    unsigned    batch       = 1;            // writes per transaction
+    unsigned    fields      = 10;
+    unsigned    field_length = 100;
+    unsigned    max_scan    = 100;
+    string      file;
+};
+
+static void usage(const char* argv0) {
+    fprintf(stderr,
+        "Usage: %s [options]\n"
+        "    --workloads LETTERS   Workloads to run, from A-F (default ABCDEF)\n"
+        "    --threads N           Client threads (default 4)\n"
+        "    --records N           Records loaded before each workload (default 100000)\n"
+        "    --operations N        Operations per workload (default 200000)\n"
+        "    --journal MODE        delete|truncate|persist|memory|wal|off (default wal)\n"
+        "    --cache-kb N          Page cache size per connection, in KB (default 2000)\n"
+        "    --batch N             Writes per transaction (default 1)\n"
+        "    --fields N            Fields per record (default 10)\n"
+        "    --field-length N      Bytes per field (default 100)\n"
+        "    --file PATH           Database file (default: in the temp directory)\n",
+        argv0);
+    exit(1);
+}
+
+static options parse_options(int argc, const char* argv[]) {
+    options opt;
+    for (int i = 1; i < argc; ++i) {
+        string_view arg = argv[i];
+        if (i + 1 >= argc)
+            usage(argv[0]);
+        const char* value = argv[++i];
+        auto number = [&] {
+            char* end;
+            unsigned long long n = strtoull(value, &end, 10);
+            if (*end || n == 0)
+                usage(argv[0]);
+            return n;
+        };
+        if (arg == "--workloads")           opt.workloads = value;
+        else if (arg == "--threads")        opt.threads = unsigned(number());
+        else if (arg == "--records")        opt.records = number();
+        else if (arg == "--operations")     opt.operations = number();
+        else if (arg == "--journal")        opt.journal = value;
+        else if (arg == "--cache-kb")       opt.cache_kb = int64_t(number());
+        else if (arg == "--batch")          opt.batch = unsigned(number());
+        else if (arg == "--fields")         opt.fields = unsigned(number());
+        else if (arg == "--field-length")   opt.field_length = unsigned(number());
+        else if (arg == "--file")           opt.file = value;
+        else                                usage(argv[0]);
+    }
+    static constexpr string_view kJournalModes[] = {"delete", "truncate", "persist",
+                                                    "memory", "wal", "off"};
+    if (ranges::find(kJournalModes, opt.journal) == end(kJournalModes))
+        usage(argv[0]);
+    for (char w : opt.workloads)
+        if (w < 'A' || w > 'F')
+            usage(argv[0]);
+    if (opt.file.empty())
+        opt.file = (filesystem::temp_directory_path() / "sqnice_ycsb.sqlite3").string();
+    return opt;
+}
+
+
+#pragma mark - WORKLOADS:
+
+
+enum op_type {read_op, update_op, insert_op, scan_op, rmw_op, kNumOps};
+
+static constexpr const char* kOpNames[kNumOps] = {"read", "update", "insert", "scan", "rmw"};
+
+enum class distribution {zipfian, latest};
+
+struct workload {
+    char            name;
+    const char*     description;
+    double          mix[kNumOps];       // proportion of each op_type
+    distribution    dist;
+};
+
+static constexpr workload kWorkloads[] = {
+    {'A', "update heavy",       {0.50, 0.50, 0,    0,    0},    distribution::zipfian},
+    {'B', "read mostly",        {0.95, 0.05, 0,    0,    0},    distribution::zipfian},
+    {'C', "read only",          {1.00, 0,    0,    0,    0},    distribution::zipfian},
+    {'D', "read latest",        {0.95, 0,    0.05, 0,    0},    distribution::latest},
+    {'E', "short ranges",       {0,    0,    0.05, 0.95, 0},    distribution::zipfian},
+    {'F', "read-modify-write",  {0.50, 0,    0,    0,    0.50}, distribution::zipfian},
+};
+
+
+// Maps a record number to its key. YCSB hashes record numbers so that inserts aren't
+// in key order and popular records aren't adjacent.
+static int64_t key_for(uint64_t record) {
+    uint64_t h = 0xcbf29ce484222325;            // FNV-1a
+    for (int i = 0; i < 8; ++i) {
+        h ^= (record >> (8 * i)) & 0xFF;
+        h *= 0x100000001b3;
+    }
+    return int64_t(h >> 1);
+}
+
+
+// YCSB's ZipfianGenerator (Gray et al., "Quickly Generating Billion-Record Synthetic
+// Databases"), with theta 0.99. The item count can grow, as records are inserted.
+class zipfian {
+public:
+    explicit zipfian(uint64_t n)
+    :zeta2_(zeta(0, 2, 0))
+    ,zetan_(zeta(0, n, 0))
+    ,n_(n)
+    {
+        update_eta();
+    }
+
+    // Returns a number in [0, n); smaller numbers are more popular.
+    uint64_t next(mt19937_64& rng, uint64_t n) {
+        if (n > n_) {
+            zetan_ = zeta(n_, n, zetan_);
+            n_ = n;
+            update_eta();
+        }
+        double u = uniform_real_distribution<double>(0, 1)(rng);
+        double uz = u * zetan_;
+        if (uz < 1.0)
+            return 0;
+        if (uz < 1.0 + pow(0.5, kTheta))
+            return 1;
+        return min(n_ - 1, uint64_t(double(n_) * pow(eta_ * u - eta_ + 1, alpha_)));
+    }
+
+private:
+    static constexpr double kTheta = 0.99;
+
+    static double zeta(uint64_t from, uint64_t to, double initial) {
+        double sum = initial;
+        for (uint64_t i = from; i < to; ++i)
+            sum += 1 / pow(double(i + 1), kTheta);
+        return sum;
+    }
+
+    void update_eta() {
+        eta_ = (1 - pow(2.0 / double(n_), 1 - kTheta)) / (1 - zeta2_ / zetan_);
+    }
+
+    double const    alpha_ = 1 / (1 - kTheta);
+    double const    zeta2_;
+    double          zetan_;
+    double          eta_;
+    uint64_t        n_;
+};
+
+
+#pragma mark - DRIVER:
+
+
+class driver {
+public:
+    explicit driver(options const& opt)
+    :opt_(opt)
+    ,pool_(opt.file, sqnice::open_flags::delete_first | sqnice::open_flags::readwrite
+                     | sqnice::open_flags::create)
+    {
+        pool_.set_capacity(max(2u, opt.threads + 1));
+        pool_.on_open([this](sqnice::database& db) {
+            db.setup_connection();
+            db.execute("PRAGMA cache_size = -" + to_string(opt_.cache_kb));
+            if (db.is_writeable())
+                db.execute("PRAGMA journal_mode = " + opt_.journal);
+        });
+
+        string cols, params, assignments;
+        for (unsigned f = 0; f < opt.fields; ++f) {
+            cols += ", field" + to_string(f) + " TEXT";
+            params += ", ?";
+            update_sql_.push_back("UPDATE usertable SET field" + to_string(f)
+                                  + " = ?1 WHERE key = ?2");
+        }
+        create_sql_ = "CREATE TABLE usertable (key INTEGER PRIMARY KEY" + cols + ")";
+        insert_sql_ = "INSERT INTO usertable VALUES (?" + params + ")";
+
+        // Random field values, generated up front so that generating them isn't measured:
+        mt19937_64 rng(1234);
+        uniform_int_distribution<int> letter(' ', '~');
+        values_.resize(1024);
+        for (auto& v : values_) {
+            v.resize(opt.field_length);
+            for (char& c : v)
+                c = char(letter(rng));
+        }
+    }
+
+    ~driver() {
+        pool_.close_all();
+        for (const char* suffix : {"", "-wal", "-shm", "-journal"})
+            filesystem::remove(opt_.file + suffix);
+    }
+
+    void run(workload const& w) {
+        load();
+        printf("Workload %c: %s\n", w.name, w.description);
+        for (auto& h : histograms_)
+            h.reset();
+        not_found_ = 0;
+        errors_ = 0;
+
+        auto start = clock_type::now();
+        vector<thread> threads;
+        for (unsigned t = 0; t < opt_.threads; ++t) {
+            uint64_t n = opt_.operations / opt_.threads
+                         + (t < opt_.operations % opt_.threads);
+            threads.emplace_back([this, &w, t, n] {client(w, t, n);});
+        }
+        for (auto& t : threads)
+            t.join();
+        chrono::duration<double> elapsed = clock_type::now() - start;
+
+        printf("    %-10s %12.0f ops/s  (%llu ops in %.2f sec)\n", "throughput",
+               double(opt_.operations) / elapsed.count(),
+               (unsigned long long)opt_.operations, elapsed.count());
+        if (not_found_ > 0 || errors_ > 0)
+            printf("    %-10s %llu not found, %llu failed\n", "",
+                   (unsigned long long)not_found_.load(), (unsigned long long)errors_.load());
+        printf("    %-10s %10s %10s %10s %10s %10s %10s   (usec)\n",
+               "op", "count", "mean", "p50", "p99", "p999", "max");
+        sqnice::latency_histogram all;
+        for (int op = 0; op < kNumOps; ++op) {
+            if (histograms_[op].count() > 0) {
+                print_latency(kOpNames[op], histograms_[op]);
+                all.merge(histograms_[op]);
+            }
+        }
+        print_latency("all", all);
+        printf("\n");
+    }
+
+private:
+    // Deletes & recreates the database and loads `opt_.records` records into it.
+    void load() {
+        pool_.close_all();
+        pool_.set_capacity(max(2u, opt_.threads + 1));
+        {
+            sqnice::transaction txn(pool_);
+            sqnice::database& db = txn.active_database();
+            db.execute("DROP TABLE IF EXISTS usertable");
+            db.execute(create_sql_);
+            txn.commit();
+        }
+        auto start = clock_type::now();
+        constexpr uint64_t kLoadBatch = 10'000;
+        for (uint64_t first = 0; first < opt_.records; first += kLoadBatch) {
+            sqnice::transaction txn(pool_);
+            sqnice::database& db = txn.active_database();
+            for (uint64_t r = first; r < min(first + kLoadBatch, opt_.records); ++r)
+                insert(db, r);
+            txn.commit();
+        }
+        records_ = opt_.records;
+        next_insert_ = opt_.records;
+        chrono::duration<double> elapsed = clock_type::now() - start;
+        printf("(loaded %llu records in %.2f sec; %u threads, journal %s, cache %lld KB, "
+               "batch %u)\n",
+               (unsigned long long)opt_.records, elapsed.count(), opt_.threads,
+               opt_.journal.c_str(), (long long)opt_.cache_kb, opt_.batch);
+    }
+
+    // A pending write, waiting for its transaction to commit.
+    struct write {
+        op_type             op;
+        uint64_t            record;
+        unsigned            field;
+        clock_type::time_point  start;
+    };
+
+    // The body of a client thread: runs `n` operations of workload `w`.
+    void client(workload const& w, unsigned thread_no, uint64_t n) {
+        mt19937_64 rng(thread_no + 1);
+        discrete_distribution<int> choose_op(begin(w.mix), end(w.mix));
+        uniform_int_distribution<unsigned> choose_field(0, opt_.fields - 1);
+        uniform_int_distribution<unsigned> choose_length(1, opt_.max_scan);
+        zipfian zipf(records_);
+        vector<write> pending;
+
+        auto choose_record = [&] {
+            uint64_t count = records_.load(memory_order_relaxed);
+            uint64_t z = zipf.next(rng, count);
+            if (w.dist == distribution::latest)
+                return count - 1 - z;
+            return uint64_t(key_for(z)) % count;        // YCSB's "scrambled" zipfian
+        };
+
+        for (uint64_t i = 0; i < n; ++i) {
+            auto op = op_type(choose_op(rng));
+            auto start = clock_type::now();
+            try {
+                switch (op) {
+                    case read_op:
+                        read(choose_record());
+                        break;
+                    case scan_op:
+                        scan(choose_record(), choose_length(rng));
+                        break;
+                    case update_op:
+                        pending.push_back({op, choose_record(), choose_field(rng), start});
+                        break;
+                    case insert_op:
+                        pending.push_back({op, next_insert_++, 0, start});
+                        break;
+                    case rmw_op: {
+                        uint64_t record = choose_record();
+                        read(record);
+                        pending.push_back({op, record, choose_field(rng), start});
+                        break;
+                    }
+                    default:
+                        break;
+                }
+            } catch (sqnice::database_error const&) {
+                ++errors_;
+            }
+            if (op == read_op || op == scan_op)
+                histograms_[op].record(clock_type::now() - start);
+            else if (pending.size() >= opt_.batch)
+                commit(pending);
+        }
+        commit(pending);
+    }
+
+    void read(uint64_t record) {
+        auto db = pool_.borrow();
+        size_t bytes = 0;
+        for (auto row : db->cached_query("SELECT * FROM usertable WHERE key = ?")(key_for(record)))
+            for (unsigned f = 1; f <= opt_.fields; ++f)
+                bytes += row[f].size_bytes();
+        if (bytes == 0)
+            ++not_found_;
+    }
+
+    void scan(uint64_t record, unsigned length) {
+        auto db = pool_.borrow();
+        size_t bytes = 0;
+        auto& q = db->cached_query("SELECT * FROM usertable WHERE key >= ? ORDER BY key LIMIT ?");
+        for (auto row : q(key_for(record), length))
+            for (unsigned f = 1; f <= opt_.fields; ++f)
+                bytes += row[f].size_bytes();
+        if (bytes == 0)
+            ++not_found_;
+    }
+
+    void insert(sqnice::database& db, uint64_t record) {
+        sqnice::command& cmd = db.cached_command(insert_sql_);
+        cmd.bind(1, key_for(record));
+        for (unsigned f = 0; f < opt_.fields; ++f)
+            cmd.bind(int(f + 2), sqnice::uncopied_string(value_for(record + f)));
+        cmd.execute();
+    }
+
+    // Executes the pending writes in one transaction, then records their latencies.
+    void commit(vector<write>& pending) {
+        if (pending.empty())
+            return;
+        bool committed = false;
+        try {
+            sqnice::transaction txn(pool_);
+            sqnice::database& db = txn.active_database();
+            for (write const& w : pending) {
+                if (w.op == insert_op) {
+                    insert(db, w.record);
+                } else {
+                    db.cached_command(update_sql_[w.field]).execute(
+                                                value_for(w.record + w.field), key_for(w.record));
+                }
+            }
+            txn.commit();
+            committed = true;
+        } catch (sqnice::database_error const&) {
+            errors_ += pending.size();
+        }
+        auto now = clock_type::now();
+        for (write const& w : pending) {
+            histograms_[w.op].record(now - w.start);
+            if (w.op == insert_op && committed)
+                ++records_;     // the new record may now be read
+        }
+        pending.clear();
+    }
+
+    string_view value_for(uint64_t n) const     {return values_[n % values_.size()];}
+
+    static void print_latency(const char* label, sqnice::latency_histogram const& h) {
+        auto us = [](chrono::nanoseconds ns) {return double(ns.count()) / 1000.0;};
+        printf("    %-10s %10llu %10.1f %10.1f %10.1f %10.1f %10.1f\n",
+               label, (unsigned long long)h.count(), us(h.mean()),
+               us(h.percentile(0.50)), us(h.percentile(0.99)), us(h.percentile(0.999)),
+               us(h.max()));
+    }
+
+    options const&                                  opt_;
+    sqnice::pool                                    pool_;
+    string                                          create_sql_, insert_sql_;
+    vector<string>                                  update_sql_;
+    vector<string>                                  values_;
+    atomic<uint64_t>                                records_ = 0;
+    atomic<uint64_t>                                next_insert_ = 0;
+    atomic<uint64_t>                                not_found_ = 0, errors_ = 0;
+    array<sqnice::latency_histogram, kNumOps>       histograms_;
+};
+
+
+int main(int argc, const char* argv[]) {
+#ifndef NDEBUG
+    printf("WARNING: This is a debug build; timings will not be representative.\n\n");
+#endif
+    options opt = parse_options(argc, argv);
+    driver d(opt);
+    for (char name : opt.workloads)
+        for (workload const& w : kWorkloads)
+            if (w.name == name)
+                d.run(w);
+    return 0;
+}
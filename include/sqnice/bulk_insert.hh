@@ -0,0 +1,219 @@
+// sqnice/bulk_insert.hh
+//
+// The MIT License
+//
+// Copyright (c) 2015 Wongoo Lee (iwongu at gmail dot com)
+// Copyright (c) 2024 Jens Alfke (Github: snej)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#pragma once
+#ifndef SQNICE_BULK_INSERT_H
+#define SQNICE_BULK_INSERT_H
+
+#include "sqnice/query.hh"
+#include <chrono>
+#include <memory>
+#include <string>
+#include <tuple>
+#include <vector>
+
+ASSUME_NONNULL_BEGIN
+
+namespace sqnice {
+
+    /** Statistics about the rows written by a `bulk_inserter`. */
+    struct bulk_insert_stats {
+        uint64_t                    rows = 0;           ///< Number of rows written
+        uint64_t                    statements = 0;     ///< Number of INSERT statements executed
+        uint64_t                    changes = 0;        ///< Rows actually changed (see ON CONFLICT)
+        std::chrono::nanoseconds    elapsed {};         ///< Time spent binding and executing
+
+        /// The average throughput, in rows per second.
+        double rows_per_second() const noexcept {
+            return elapsed.count() > 0 ? rows * 1e9 / double(elapsed.count()) : 0.0;
+        }
+    };
+
+
+    /** Non-template base class of `bulk_inserter`. */
+    class bulk_inserter_base : noncopyable {
+    public:
+        /// The number of rows written by each full INSERT statement.
+        size_t rows_per_chunk() const noexcept              {return rows_per_chunk_;}
+
+        /// Statistics about the rows written so far.
+        bulk_insert_stats const& stats() const noexcept     {return stats_;}
+
+    protected:
+        using clock = std::chrono::steady_clock;
+
+        bulk_inserter_base(database&,
+                           std::string_view table,
+                           std::vector<std::string> columns,
+                           std::string_view on_conflict);
+        ~bulk_inserter_base();
+
+        /// Returns a command that inserts `nrows` rows.
+        command& chunk_command(size_t nrows);
+        /// Executes the command returned by `chunk_command`, and updates the stats.
+        status execute_chunk(command&, size_t nrows, clock::time_point start);
+
+        template <typename T>
+        static status bind_column(command& cmd, int idx, T const& value) {
+            return static_cast<statement&>(cmd)._bind_uncopied(idx, value);
+        }
+
+    private:
+        std::string sql_for(size_t nrows) const;
+
+        database&                   db_;
+        std::string const           table_;
+        std::vector<std::string>    columns_;
+        std::string const           on_conflict_;
+        size_t                      rows_per_chunk_;
+        std::unique_ptr<command>    full_chunk_;        // Statement that inserts a full chunk
+        std::unique_ptr<command>    remainder_;         // Statement for a partial chunk
+        size_t                      remainder_rows_ = 0;// Number of rows `remainder_` inserts
+        bulk_insert_stats           stats_;
+    };
+
+
+    /** Inserts rows into a table efficiently, by buffering them and then writing many at once
+        with multi-row `INSERT INTO table (cols) VALUES (?,?),(?,?),...` statements.
+
+        The number of rows per statement ("chunk") is the largest the database's limit on the
+        number of statement parameters allows. The full-chunk statement is compiled once; the
+        final partial chunk written by `flush` uses a statement the inserter owns, which is kept
+        for reuse as long as the partial chunks are the same size.
+
+        Call `insert` to add rows; every time a chunk fills up it's written. When you're done,
+        call `flush` to write the remaining rows. For best performance, and atomicity, do all of
+        this inside a `transaction`.
+
+        If writing a chunk fails, e.g. because a row violates a constraint, the error is thrown
+        or returned, and all of the chunk's rows are discarded. Inside a transaction, you'll
+        usually want to abort it.
+
+        Strings and blobs are bound without copying, from the inserter's buffer.
+
+        @tparam Ts  The C++ types of the columns. */
+    template <typename... Ts>
+    class bulk_inserter : public bulk_inserter_base {
+    public:
+        using row_type = std::tuple<Ts...>;
+
+        /// Constructs a `bulk_inserter`.
+        /// @param db  The database.
+        /// @param table  The name of the table to insert into.
+        /// @param columns  The names of the columns to insert; must match the number of `Ts`.
+        /// @param on_conflict  An optional clause to append after the `VALUES` list, such as
+        ///             `ON CONFLICT DO NOTHING` or an upsert clause.
+        /// @throws std::invalid_argument if the number of columns is wrong, or there are too
+        ///             many to fit in one statement.
+        bulk_inserter(database& db,
+                      std::string_view table,
+                      std::vector<std::string> columns,
+                      std::string_view on_conflict = {})
+        :bulk_inserter_base(db, table, check_columns(std::move(columns)), on_conflict)
+        {
+            rows_.reserve(std::min(rows_per_chunk(), size_t(1024)));
+        }
+
+        /// The destructor does _not_ write pending rows, since it can't report errors; it logs
+        /// a warning if there are any. Call `flush` first.
+        ~bulk_inserter() {
+            if (!rows_.empty())
+                checking::log_warning("bulk_inserter destructed with %llu rows not flushed",
+                                      (unsigned long long)rows_.size());
+        }
+
+        /// Adds a row. If this fills a chunk, the chunk is written to the database.
+        template <typename... Args>
+        status insert(Args&&... args) {
+            static_assert(sizeof...(Args) == sizeof...(Ts), "wrong number of column values");
+            rows_.emplace_back(std::forward<Args>(args)...);
+            return (rows_.size() >= rows_per_chunk()) ? write_pending() : status::ok;
+        }
+
+        /// Adds a row given as a tuple.
+        status insert(row_type row) {
+            rows_.push_back(std::move(row));
+            return (rows_.size() >= rows_per_chunk()) ? write_pending() : status::ok;
+        }
+
+        /// Adds every row from a range of tuples.
+        template <std::ranges::input_range R>
+        status insert_all(R&& rows) {
+            for (auto&& row : rows) {
+                if (auto rc = insert(row_type(row)); !ok(rc))
+                    return rc;
+            }
+            return status::ok;
+        }
+
+        /// The number of rows added but not yet written.
+        size_t pending() const noexcept                 {return rows_.size();}
+
+        /// Writes all pending rows to the database.
+        status flush() {
+            return rows_.empty() ? status::ok : write_pending();
+        }
+
+    private:
+        static std::vector<std::string> check_columns(std::vector<std::string> columns) {
+            if (columns.size() != sizeof...(Ts))
+                throw std::invalid_argument("bulk_inserter: number of columns doesn't match");
+            return columns;
+        }
+
+        // Writes all of `rows_` in one statement. Afterwards, whether or not it succeeded,
+        // no rows are pending; so there are never more than a chunk's worth.
+        status write_pending() {
+            auto start = clock::now();
+            size_t nrows = rows_.size();
+            command& cmd = chunk_command(nrows);
+            status rc = status::ok;
+            try {
+                int idx = 1;
+                for (row_type const& row : rows_) {
+                    std::apply([&](auto const&... cols) {
+                        ((ok(rc) ? (void)(rc = bind_column(cmd, idx++, cols)) : (void)0), ...);
+                    }, row);
+                }
+                if (ok(rc))
+                    rc = execute_chunk(cmd, nrows, start);
+            } catch (...) {
+                cmd.clear_bindings();
+                rows_.clear();
+                throw;
+            }
+            cmd.clear_bindings();   // they point into `rows_`, which is about to change
+            rows_.clear();
+            return rc;
+        }
+
+        std::vector<row_type> rows_;
+    };
+
+}
+
+ASSUME_NONNULL_END
+
+#endif
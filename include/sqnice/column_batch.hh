@@ -0,0 +1,134 @@
+// sqnice/column_batch.hh
+//
+// The MIT License
+//
+// Copyright (c) 2015 Wongoo Lee (iwongu at gmail dot com)
+// Copyright (c) 2024 Jens Alfke (Github: snej)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#pragma once
+#ifndef SQNICE_COLUMN_BATCH_H
+#define SQNICE_COLUMN_BATCH_H
+
+#include "sqnice/query.hh"
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string_view>
+#include <vector>
+
+ASSUME_NONNULL_BEGIN
+
+struct sqlite3_stmt;
+
+namespace sqnice {
+
+    /** A batch of query results stored column-major: each column's values are in a contiguous
+        typed array, which is convenient for analytics or vectorized (SIMD) processing.
+        Fill one by calling `query::fetch_columns` or `query::iterator::fetch_columns`.
+
+        A batch can be reused for many fetches; its buffers keep their capacity, so a steady-state
+        scan doesn't allocate memory.
+
+        Each column's type is inferred from its first non-null value; subsequent values are
+        converted to that type, as with `sqlite3_column_int64`, etc. */
+    class column_batch {
+    public:
+        /** The values of one column of a `column_batch`. */
+        class column {
+        public:
+            /// The type of the column's values, or `null` if every value so far is null.
+            data_type type() const noexcept                 {return type_;}
+
+            /// True if the value in row `i` is null.
+            bool is_null(size_t i) const noexcept {
+                return (nulls_[i / 64] >> (i % 64)) & 1;
+            }
+
+            /// The null bitmap: bit `i % 64` of word `i / 64` is set if row `i` is null.
+            std::span<const uint64_t> nulls() const noexcept {return nulls_;}
+
+            /// The values of an `integer` column. (Null values are stored as 0.)
+            std::span<const int64_t> integers() const noexcept  {return ints_;}
+
+            /// The values of a `floating_point` column. (Null values are stored as 0.)
+            std::span<const double> doubles() const noexcept    {return doubles_;}
+
+            /// The offsets of a `text` or `blob` column's values in `data()`. Row `i`'s value
+            /// occupies bytes `offsets()[i]` up to `offsets()[i+1]`. (Null values are empty.)
+            std::span<const size_t> offsets() const noexcept    {return offsets_;}
+
+            /// The concatenated data of a `text` or `blob` column's values.
+            std::span<const std::byte> data() const noexcept    {return data_;}
+
+            /// The text value in row `i` of a `text` column.
+            std::string_view text(size_t i) const noexcept {
+                return {reinterpret_cast<const char*>(data_.data()) + offsets_[i],
+                        offsets_[i + 1] - offsets_[i]};
+            }
+
+            /// The blob value in row `i` of a `blob` column.
+            std::span<const std::byte> bytes(size_t i) const noexcept {
+                return {data_.data() + offsets_[i], offsets_[i + 1] - offsets_[i]};
+            }
+
+        private:
+            friend class column_batch;
+            void clear() noexcept;
+            void set_type(data_type, size_t rows);
+            void append(sqlite3_stmt*, int idx, size_t row);
+
+            data_type               type_ = data_type::null;
+            std::vector<uint64_t>   nulls_;
+            std::vector<int64_t>    ints_;
+            std::vector<double>     doubles_;
+            std::vector<size_t>     offsets_;
+            std::vector<std::byte>  data_;
+        };
+
+        /// The number of rows in the batch.
+        size_t row_count() const noexcept                   {return rows_;}
+
+        /// The number of columns in the batch.
+        size_t column_count() const noexcept                {return columns_.size();}
+
+        /// The `i`th column.
+        column const& operator[] (size_t i) const noexcept  {return columns_[i];}
+
+        /// Removes all rows, but keeps the allocated memory and the columns' types.
+        void clear() noexcept;
+
+        /// Removes all rows and columns, and forgets the columns' types.
+        void reset() noexcept                               {columns_.clear(); rows_ = 0;}
+
+    private:
+        friend class query::iterator;
+        void start(unsigned ncolumns);
+        void append_row(sqlite3_stmt*);
+
+        std::vector<column> columns_;
+        size_t              rows_ = 0;
+    };
+
+}
+
+ASSUME_NONNULL_END
+
+#endif
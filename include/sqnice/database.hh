@@ -28,14 +28,18 @@
 #define SQNICE_DATABASE_H
 
 #include "sqnice/base.hh"
+#include "sqnice/sql_literal.hh"
+#include <chrono>
 #include <functional>
 #include <optional>
 #include <tuple>
+#include <vector>
 
 ASSUME_NONNULL_BEGIN
 
 struct sqlite3;
 struct sqlite3_context;
+struct sqlite3_stmt;
 struct sqlite3_value;
 
 namespace sqnice {
@@ -85,6 +89,7 @@ namespace sqnice {
         sql_length      =  1,
         columns         =  2,
         function_args   =  6,
+        variables       =  9,   // max number of parameters, i.e. largest `?NNN` index
         worker_threads  = 11,
     };
 
@@ -100,6 +105,56 @@ namespace sqnice {
         return function_flags(int(a) | int(b));}
 
 
+    /** Statistics about one of a `database`'s caches of compiled statements. */
+    struct statement_cache_stats {
+        size_t      capacity = 0;       ///< Maximum number of statements the cache holds
+        size_t      count = 0;          ///< Number of statements currently cached
+        uint64_t    hits = 0;           ///< Lookups that found an already-compiled statement
+        uint64_t    misses = 0;         ///< Lookups that had to compile a new statement
+        uint64_t    evictions = 0;      ///< Statements evicted to make room for newer ones
+        size_t      memory_used = 0;    ///< Heap memory used by the cached statements, in bytes
+    };
+
+
+    /** Runtime counters of a compiled statement, from `sqlite3_stmt_status`; returned by
+        `statement::stats`. Nonzero `fullscan_steps`, `sorts` or `autoindexes` in a frequently
+        run statement usually mean an index is missing. */
+    struct statement_stats {
+        uint64_t    fullscan_steps = 0; ///< Forward steps through a table during a full scan
+        uint64_t    sorts = 0;          ///< Sort operations performed
+        uint64_t    autoindexes = 0;    ///< Rows inserted into transient automatic indexes
+        uint64_t    vm_steps = 0;       ///< Virtual machine operations; a measure of total work
+        uint64_t    reprepares = 0;     ///< Times recompiled because of a schema change, etc.
+        uint64_t    runs = 0;           ///< Times the statement has been run
+        uint64_t    filter_hits = 0;    ///< Join steps skipped because a Bloom filter said no
+        uint64_t    filter_misses = 0;  ///< Join steps a Bloom filter didn't let it skip
+        size_t      memory_used = 0;    ///< Heap memory used by the statement, in bytes
+
+        statement_stats& operator+= (statement_stats const&) noexcept;
+    };
+
+
+    /** Describes a statement that just finished running; passed to a `profile_handler`. */
+    struct statement_profile {
+        sqlite3_stmt*               stmt;       ///< The statement
+        std::chrono::nanoseconds    duration;   ///< Wall-clock time it took to run
+        std::chrono::steady_clock::time_point start; ///< When it started running
+
+        /// The statement's SQL. (This is cheap.)
+        std::string_view sql() const noexcept;
+        /// The SQL with parameters replaced by their bound values. (This allocates a string.)
+        std::string expanded_sql() const;
+    };
+
+
+    /** One statement's entry in `database::statement_report`. */
+    struct statement_report_entry {
+        std::string     sql;            ///< The statement's SQL
+        unsigned        instances = 0;  ///< Number of compiled instances of this SQL
+        statement_stats stats;          ///< Counters, summed over all the instances
+    };
+
+
     /** A SQLite database connection. */
     class database : public checking, noncopyable {
     public:
@@ -340,8 +395,75 @@ namespace sqnice {
         /// Returns a `query` object that will run the given SQL statement.
         /// @note This object comes from an internal `command_cache`, so subsequent calls with the
         ///       same SQL string will use the precompiled statement instead of compiling it again.
+        ///       If the cached statement is already in use, as in a nested loop over the same
+        ///       query, another instance is compiled and cached.
         [[nodiscard]] sqnice::query query(std::string_view sql) const;
 
+        /// Like `command`, but returns a reference to the cached `command` object itself instead
+        /// of a copy, which is faster. The statement's bindings are _not_ cleared first, so be
+        /// sure to bind every parameter.
+        /// @warning  The reference remains valid only until the command is evicted from the cache,
+        ///           which can happen after `statement_cache_capacity()` more cache misses, or
+        ///           until the database is closed. Don't hold onto it.
+        [[nodiscard]] sqnice::command& cached_command(std::string_view sql);
+
+        /// Like `query`, but returns a reference to the cached `query` object itself instead
+        /// of a copy, which is faster. The statement's bindings are _not_ cleared first, so be
+        /// sure to bind every parameter.
+        /// @warning  The reference remains valid only until the query is evicted from the cache,
+        ///           which can happen after `statement_cache_capacity()` more cache misses, or
+        ///           until the database is closed. Don't hold onto it.
+        [[nodiscard]] sqnice::query& cached_query(std::string_view sql) const;
+
+        /// Returns a `command` for a SQL string literal given as a template parameter, like
+        /// `db.command<"DELETE FROM users WHERE id=?">(id).execute()`.
+        /// This is faster than `cached_command`: each distinct literal has a process-wide slot
+        /// number, so its compiled statement is found by array index, without any hashing or
+        /// string comparisons.
+        ///
+        /// If arguments are given, they're bound to the parameters starting at 1; the number of
+        /// arguments must equal the number of parameters, or the call won't compile.
+        /// @note  Like `cached_command`, this returns a reference to a cached object and doesn't
+        ///        clear its bindings. But literal statements are never evicted, so the reference
+        ///        remains valid until the database is closed.
+        /// @note  If the literal's statement is in use, as in a nested loop over the same query,
+        ///        this falls back to `cached_command`, which can hold more instances.
+        /// @note  You must include "sqnice/query.hh" to call this.
+        template <sql_literal SQL, typename... Args>
+        sqnice::command& command(Args&&... args);
+
+        /// Returns a `query` for a SQL string literal given as a template parameter, like
+        /// `db.query<"SELECT name FROM users WHERE id=?">(id)`.
+        /// This is the `query` equivalent of the `command<SQL>` method; see its documentation.
+        /// @note  You must include "sqnice/query.hh" to call this.
+        template <sql_literal SQL, typename... Args>
+        sqnice::query& query(Args&&... args) const;
+
+        /// The default maximum number of statements in each of the `command` and `query` caches.
+        static constexpr size_t kDefaultStatementCacheCapacity = 100;
+
+        /// The maximum number of compiled statements kept in each of the caches used by
+        /// `command` and `query`. When a cache is full, its least recently used statement is
+        /// evicted.
+        size_t statement_cache_capacity() const noexcept {return stmt_cache_capacity_;}
+
+        /// Sets the capacity of the `command` and `query` caches, evicting statements if necessary.
+        /// A capacity of 0 disables caching.
+        void set_statement_cache_capacity(size_t);
+
+        /// Statistics about the cache used by the `command` method.
+        statement_cache_stats command_cache_stats() const noexcept;
+
+        /// Statistics about the cache used by the `query` method.
+        statement_cache_stats query_cache_stats() const noexcept;
+
+        /// Returns the runtime counters of every statement cached by this database -- those
+        /// returned by `command`, `query` and their literal variants -- sorted by descending
+        /// `vm_steps`, so the most expensive statements come first.
+        /// @param reset  If true, the counters are reset to zero after being read, so that the
+        ///               next report covers only the interval since this one.
+        std::vector<statement_report_entry> statement_report(bool reset = false) const;
+
         /// Low-level transaction support: begins a transaction.
         /// Transactions can nest; nested transactions are implemented as savepoints.
         /// @note It's usually better to use the higher-level `transaction` class instead.
@@ -457,6 +579,7 @@ namespace sqnice {
                                                         char const* _Nullable arg2,
                                                         char const* _Nullable dbName,
                                                         char const* _Nullable triggerOrView)>;
+        using profile_handler = std::function<void (statement_profile const&)>;
 
         void set_busy_handler(busy_handler) noexcept;
         void set_commit_handler(commit_handler) noexcept;
@@ -464,6 +587,19 @@ namespace sqnice {
         void set_update_handler(update_handler) noexcept;
         void set_authorize_handler(authorize_handler) noexcept;
 
+        /// Registers a function to be called each time a statement finishes running, i.e. when
+        /// it's reset or returns its last row, with its SQL and how long it took. The handler is
+        /// also called for statements run by `execute`, and for nested statements in triggers.
+        /// It's called on the thread using the database, so it should be fast.
+        /// Based on `sqlite3_trace_v2` with `SQLITE_TRACE_PROFILE`. (See `slow_query_log`.)
+        /// The profile's `start` is taken from `SQLITE_TRACE_STMT`, so it's exact, whereas its
+        /// `duration` comes from SQLite's timer, which often has only millisecond resolution.
+        void set_profile_handler(profile_handler) noexcept;
+
+        /// The current profile handler, if any. (To add a handler without replacing the
+        /// existing one, have the new handler call it.)
+        profile_handler const& get_profile_handler() const noexcept;
+
         using argv_t = sqlite3_value* _Nullable * _Nullable;
         using callFn = void (*)(sqlite3_context*, int, argv_t);
         using finishFn = void (*)(sqlite3_context*);
@@ -491,6 +627,27 @@ namespace sqnice {
         void tear_down() noexcept;
         void set_borrowed(bool b) const noexcept            {borrowed_ = b;}
         status executef(char const* sql, ...)   sqnice_printflike(2, 3);
+        static int trace_impl(unsigned type, void* p, void* stmt, void* x) noexcept;
+
+        // internal gunk used by the `command<SQL>` and `query<SQL>` methods.
+        // Template implementations are in query.hh.
+        static unsigned new_literal_slot() noexcept;
+        template <sql_literal SQL> static unsigned literal_slot() noexcept {
+            static const unsigned slot = new_literal_slot();
+            return slot;
+        }
+        sqnice::command& literal_command(unsigned slot, std::string_view sql) {
+            if (slot < literal_commands_.size() && literal_commands_[slot]) [[likely]]
+                return *literal_commands_[slot];
+            return compile_literal_command(slot, sql);
+        }
+        sqnice::query& literal_query(unsigned slot, std::string_view sql) const {
+            if (slot < literal_queries_.size() && literal_queries_[slot]) [[likely]]
+                return *literal_queries_[slot];
+            return compile_literal_query(slot, sql);
+        }
+        sqnice::command& compile_literal_command(unsigned slot, std::string_view sql);
+        sqnice::query& compile_literal_query(unsigned slot, std::string_view sql) const;
 
         // internal gunk used by create_function and create_aggregate.
         // Implementations in functions.hh.
@@ -509,18 +666,29 @@ namespace sqnice {
 
     private:
         db_handle           db_;                    // shared_ptr<sqlite3>
+        size_t              stmt_cache_capacity_ = kDefaultStatementCacheCapacity;
         int                 txn_depth_ = 0;         // Transaction nesting level
         bool                txn_immediate_ = false; // True if outer txn is immediate
         bool                temporary_ = false;     // True if db is temporary
         bool mutable        borrowed_ = false;      // True if checked out from a `pool`
+        std::chrono::steady_clock::time_point mutable borrowed_at_; // Set by `pool` stats
         std::unique_ptr<database_error> posthumous_error_;
         std::unique_ptr<statement_cache<sqnice::command>> commands_;
         std::unique_ptr<statement_cache<sqnice::query>> mutable queries_;
+        std::vector<std::unique_ptr<sqnice::command>> literal_commands_; // indexed by literal_slot
+        std::vector<std::unique_ptr<sqnice::query>> mutable literal_queries_;
         busy_handler        bh_;
         commit_handler      ch_;
         rollback_handler    rh_;
         update_handler      uh_;
         authorize_handler   ah_;
+        // The profile handler's state. It's on the heap because SQLite has its address.
+        struct profiler {
+            profile_handler handler;
+            // Start times of the statements now running, for `statement_profile::start`:
+            std::vector<std::pair<sqlite3_stmt*, std::chrono::steady_clock::time_point>> starts;
+        };
+        std::unique_ptr<profiler> ph_;
     };
 
 }
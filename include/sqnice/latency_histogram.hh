@@ -0,0 +1,113 @@
+// sqnice/latency_histogram.hh
+//
+// The MIT License
+//
+// Copyright (c) 2015 Wongoo Lee (iwongu at gmail dot com)
+// Copyright (c) 2024 Jens Alfke (Github: snej)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#pragma once
+#ifndef SQNICE_LATENCY_HISTOGRAM_H
+#define SQNICE_LATENCY_HISTOGRAM_H
+
+#include "sqnice/base.hh"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+
+ASSUME_NONNULL_BEGIN
+
+namespace sqnice {
+
+    /** A thread-safe, fixed-size histogram of durations, cheap enough to update on every call
+        of a hot path: recording is a few relaxed atomic adds, with no locking or allocation.
+
+        Buckets are log-linear: each power of two is divided into four, so a percentile is
+        accurate to within 25% (reported as its bucket's upper bound.) The full range of
+        `uint64_t` nanoseconds fits in 252 buckets. */
+    class latency_histogram {
+    public:
+        using duration = std::chrono::nanoseconds;
+
+        latency_histogram() = default;
+
+        /// Copies a histogram, e.g. to take a snapshot. (Like `merge`, this is not atomic with
+        /// respect to concurrent `record` calls on the source.)
+        latency_histogram(latency_histogram const& h) noexcept     {merge(h);}
+        latency_histogram& operator=(latency_histogram const& h) noexcept {
+            if (&h != this) {reset(); merge(h);}
+            return *this;
+        }
+
+        /// Adds a sample. Negative durations count as zero.
+        void record(duration d) noexcept {
+            uint64_t ns = uint64_t(std::max(d.count(), int64_t(0)));
+            buckets_[bucket_index(ns)].fetch_add(1, std::memory_order_relaxed);
+            count_.fetch_add(1, std::memory_order_relaxed);
+            total_.fetch_add(ns, std::memory_order_relaxed);
+            uint64_t max = max_.load(std::memory_order_relaxed);
+            while (ns > max && !max_.compare_exchange_weak(max, ns, std::memory_order_relaxed))
+                { }
+        }
+
+        /// The number of samples recorded.
+        uint64_t count() const noexcept         {return count_.load(std::memory_order_relaxed);}
+        /// The sum of all samples.
+        duration total() const noexcept {return duration(total_.load(std::memory_order_relaxed));}
+        /// The largest sample.
+        duration max() const noexcept   {return duration(max_.load(std::memory_order_relaxed));}
+        /// The average sample, or zero if there are none.
+        duration mean() const noexcept;
+
+        /// The approximate value below which the fraction `p` (0...1) of samples fall, e.g.
+        /// `percentile(0.99)` for p99. Returns zero if there are no samples.
+        duration percentile(double p) const noexcept;
+
+        /// Clears all samples. (Not atomic with respect to concurrent `record` calls.)
+        void reset() noexcept;
+
+        /// Adds the samples of another histogram to this one.
+        void merge(latency_histogram const&) noexcept;
+
+    private:
+        static constexpr size_t kBuckets = 252;
+
+        static size_t bucket_index(uint64_t ns) noexcept {
+            if (ns < 4)
+                return size_t(ns);
+            unsigned exp = unsigned(std::bit_width(ns)) - 1;           // >= 2
+            return (exp - 1) * 4 + ((ns >> (exp - 2)) & 3);
+        }
+        static uint64_t bucket_max(size_t index) noexcept;
+
+        std::array<std::atomic<uint64_t>, kBuckets> buckets_ {};
+        std::atomic<uint64_t>   count_ = 0;
+        std::atomic<uint64_t>   total_ = 0;
+        std::atomic<uint64_t>   max_ = 0;
+    };
+
+}
+
+ASSUME_NONNULL_END
+
+#endif
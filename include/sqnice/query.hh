@@ -28,11 +28,18 @@
 #define SQNICE_QUERY_H
 
 #include "sqnice/base.hh"
+#include "sqnice/database.hh"
 #include <algorithm>
 #include <concepts>
 #include <cstddef>
+#include <memory_resource>
 #include <optional>
+#include <ranges>
 #include <span>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
 #include <cassert>
 
 ASSUME_NONNULL_BEGIN
@@ -44,6 +51,9 @@ namespace sqnice {
     class database;
     class statement;
     class column_value;
+    class column_batch;
+    class bulk_inserter_base;
+    class row_stream_base;
     template <class STMT> class statement_cache;
 
     /** SQLite's data types. (Values are equal to SQLITE_INT, etc.) */
@@ -65,6 +75,13 @@ namespace sqnice {
     };
 
 
+    /** The concept `pmr_column` identifies the allocator-aware types that text and blob column
+        values can be copied into using a `std::pmr::memory_resource`. */
+    template <typename T>
+    concept pmr_column = std::same_as<T, std::pmr::string>
+                      || std::same_as<T, std::pmr::vector<std::byte>>;
+
+
     struct null_type {};
     /** A singleton value representing SQL `NULL`, for use with the `getstream` API. */
     extern null_type ignore;  //FIXME: This is awkward; get rid of it or make it constexpr
@@ -109,6 +126,150 @@ namespace sqnice {
     inline uncopied_blob uncopied(blob const& b)                     {return uncopied_blob(b);}
 
 
+    /** The concept `owned_column` identifies column types whose values don't point into the
+        query's current row, so they remain valid after the query moves on or is reset. */
+    template <typename T>
+    concept owned_column = !std::is_pointer_v<T> && !std::same_as<T, std::string_view>
+                        && !std::same_as<T, std::span<const std::byte>> && !std::same_as<T, blob>;
+
+
+    /** A list of named statement parameters, like `{":name", ":phone"}`, to bind in that order.
+        A statement resolves the names to parameter indexes only the first time it's bound with
+        a given `parameter_names` object, and remembers them (even across statement cache
+        hits), so named binding then costs the same as positional binding.
+        @note  Create these once, e.g. as `static const` variables, not per call. */
+    class parameter_names {
+    public:
+        parameter_names(std::initializer_list<const char*> names);
+
+        /// The number of names.
+        size_t size() const noexcept                            {return names_.size();}
+        /// The names, in order.
+        std::vector<std::string> const& names() const noexcept {return names_;}
+        /// A process-wide unique identifier.
+        unsigned id() const noexcept                            {return id_;}
+
+    private:
+        std::vector<std::string> names_;
+        unsigned                 id_;
+    };
+
+
+    /** A mapping from named statement parameters to the members of a struct `T`, so that a `T`
+        can be bound to a statement in one call: `stmt.bind(map, value)`. Create one like:
+        ```
+        static const sqnice::parameter_map kContactParams {
+            sqnice::param(":name",  &contact::name),
+            sqnice::param(":phone", &contact::phone) };
+        ```
+        @tparam T  The struct type.
+        @tparam Ms  The types of the mapped members. */
+    template <class T, typename... Ms>
+    class parameter_map : public parameter_names {
+    public:
+        explicit parameter_map(std::pair<const char*, Ms T::*>... fields)
+        :parameter_names({fields.first...})
+        ,members_(fields.second...)
+        { }
+
+        std::tuple<Ms T::*...> const& members() const noexcept  {return members_;}
+
+    private:
+        std::tuple<Ms T::*...> members_;
+    };
+
+    /// Pairs a parameter name with a struct member pointer, for initializing a `parameter_map`.
+    template <class T, typename M>
+    std::pair<const char*, M T::*> param(const char* name, M T::* member) noexcept {
+        return {name, member};
+    }
+
+
+    /** The output of `EXPLAIN QUERY PLAN` for a statement, as a tree of nodes; returned by
+        `statement::plan`. The helper methods make it easy to check that a query uses an index:
+        for example, `CHECK(!q.plan().has_full_scan())` in a unit test. */
+    class query_plan {
+    public:
+        /// The kinds of plan nodes, classified from their `detail` text.
+        enum class op {
+            scan,           ///< "SCAN t", "SCAN t USING INDEX i", "SCAN CONSTANT ROW", ...
+            search,         ///< "SEARCH t USING INDEX i (a=?)", "... INTEGER PRIMARY KEY", ...
+            temp_btree,     ///< "USE TEMP B-TREE FOR ORDER BY" (or GROUP BY, DISTINCT...)
+            subquery,       ///< "SCALAR SUBQUERY", "CORRELATED LIST SUBQUERY", ...
+            compound,       ///< "COMPOUND QUERY", "MERGE (UNION)", "LEFT-MOST SUBQUERY", ...
+            materialize,    ///< "MATERIALIZE x", "CO-ROUTINE x"
+            multi_index,    ///< "MULTI-INDEX OR", and its "INDEX n" children
+            bloom_filter,   ///< "BLOOM FILTER ON t (a=?)"
+            other,
+        };
+
+        struct node {
+            int             id;         ///< Unique ID of this node
+            int             parent;     ///< ID of parent node, or 0 at top level
+            std::string     detail;     ///< SQLite's description, like "SCAN contacts"
+
+            /// The kind of operation.
+            op kind() const noexcept;
+            /// The table a SCAN or SEARCH node reads (or its alias, if it has one), else empty.
+            std::string_view table() const noexcept;
+            /// The index a SCAN or SEARCH node uses, else empty. (For a search by rowid
+            /// or integer primary key, returns "INTEGER PRIMARY KEY".)
+            std::string_view index() const noexcept;
+            /// True if this is a SCAN that reads every row of a table. This includes scanning an
+            /// index (which can avoid a sort, or reading the table itself, but still takes time
+            /// proportional to the table size.) It doesn't include scanning a subquery result.
+            bool is_full_scan() const noexcept;
+            /// True if this is a SEARCH using an automatic index, which SQLite builds at runtime
+            /// every time the statement runs, because no suitable index exists.
+            bool is_automatic_index() const noexcept;
+        };
+
+        query_plan() = default;
+        explicit query_plan(std::vector<node> nodes) noexcept  :nodes_(std::move(nodes)) { }
+
+        /// Runs `EXPLAIN QUERY PLAN` on a SQL statement.
+        /// @throws database_error if the SQL is invalid.
+        query_plan(checking const& db, std::string_view sql);
+
+        /// All the nodes, in the order SQLite returns them; parents come before children.
+        std::vector<node> const& nodes() const noexcept {return nodes_;}
+        /// The direct children of the node with ID `parent`; 0 for the top-level nodes.
+        std::vector<node const*> children(int parent = 0) const;
+
+        /// Nodes that scan an entire table; see `node::is_full_scan`.
+        std::vector<node const*> full_scans() const;
+        bool has_full_scan() const noexcept;
+        /// True if any node uses an automatic index; see `node::is_automatic_index`.
+        bool uses_automatic_index() const noexcept;
+        /// True if any node uses a temporary b-tree, to sort or for DISTINCT or GROUP BY.
+        bool uses_temp_btree() const noexcept;
+        /// True if any node reads `table` using index `index`.
+        bool uses_index(std::string_view table, std::string_view index) const noexcept;
+
+        /// The plan as indented lines of text, like the `sqlite3` shell's `.eqp` output.
+        std::string to_string() const;
+
+    private:
+        std::vector<node> nodes_;
+    };
+
+
+#ifdef SQNICE_ENABLE_SCANSTATUS
+    /** Runtime statistics of one node of a statement's query plan; returned by
+        `statement::scan_stats`. Counters SQLite can't provide are -1.
+        @note  Only available if sqnice and SQLite were built with the CMake option
+               `ENABLE_SCANSTATUS`, which defines `SQLITE_ENABLE_STMT_SCANSTATUS`. */
+    struct loop_stats {
+        query_plan::node    node;                   ///< The plan node these counters describe
+        std::string         name;                   ///< Name of the table or index, if any
+        int64_t             loops = -1;             ///< Number of times the loop started
+        int64_t             rows_visited = -1;      ///< Rows visited, over all loops
+        double              estimated_rows = -1;    ///< Planner's estimate of rows per loop
+        int64_t             cycles = -1;            ///< CPU cycles spent in this node
+    };
+#endif
+
+
     /** Abstract base class of `command` and `query`. */
     class statement : public checking {
     public:
@@ -132,6 +293,28 @@ namespace sqnice {
         /// with parameters (like "?1") replaced by their current bindings.
         std::string expanded_sql() const;
 
+        /// The amount of heap memory, in bytes, used by the compiled statement.
+        size_t memory_used() const noexcept;
+
+        /// Runs `EXPLAIN QUERY PLAN` on the statement's SQL and returns the resulting plan.
+        query_plan plan() const;
+
+        /// Returns the statement's runtime counters, such as the number of full-scan steps,
+        /// sorts and automatic indexes, which reveal missing indexes.
+        /// @param reset  If true, the counters are reset to zero after being read.
+        statement_stats stats(bool reset = false) const noexcept;
+
+#ifdef SQNICE_ENABLE_SCANSTATUS
+        /// Returns per-loop runtime statistics, one item per query plan node in the same order
+        /// as `plan().nodes()`, accumulated since the statement was compiled or since
+        /// `reset_scan_stats` was called. Comparing `rows_visited` with `estimated_rows` shows
+        /// where the planner misjudged the data; `cycles` shows where the time went.
+        std::vector<loop_stats> scan_stats() const;
+
+        /// Resets the counters returned by `scan_stats` to zero.
+        void reset_scan_stats() noexcept;
+#endif
+
         /// True if the statement is running; `reset` clears this.
         [[nodiscard]] bool busy() const noexcept;
 
@@ -152,6 +335,13 @@ namespace sqnice {
         /// Returns a sort of output stream, on which each `<<` binds the next numbered parameter.
         [[nodiscard]] bindstream binder(int idx = 1);
 
+        class fast_handle;
+        /// Returns an object with minimal-overhead versions of the bind, step and column methods,
+        /// for use in tight loops. The statement is validated and claimed once, here, instead of
+        /// on every call.
+        /// @throws std::logic_error if the statement isn't prepared or is in use by an iterator.
+        [[nodiscard]] fast_handle fast();
+
         /// The number of bindable parameters.
         int parameter_count() const noexcept;
 
@@ -217,6 +407,33 @@ namespace sqnice {
             return bind(check_parameter_index(name), v);
         }
 
+        /// Returns the (1-based) indexes of the parameters in `names`, in the same order.
+        /// They're looked up only the first time this is called with a particular
+        /// `parameter_names` object, then remembered.
+        /// @throws std::invalid_argument if a name doesn't exist (or returns 0 for it, if
+        ///         exceptions are disabled.)
+        std::span<const int> parameter_indexes(parameter_names const&);
+
+        /// Binds the arguments to the named parameters in `names`, in order.
+        template <typename... Args>
+        status bind(parameter_names const& names, Args const&... args) {
+            auto indexes = parameter_indexes(names);
+            if (indexes.size() != sizeof...(Args)) [[unlikely]]
+                throw std::invalid_argument("wrong number of arguments for parameter_names");
+            status rc = status::ok;
+            size_t i = 0;
+            ((ok(rc) ? (void)(rc = bind(indexes[i++], args)) : (void)0), ...);
+            return rc;
+        }
+
+        /// Binds the members of `value` to the named parameters, as given by `map`.
+        template <class T, typename... Ms>
+        status bind(parameter_map<T, Ms...> const& map, T const& value) {
+            return std::apply([&](auto... members) {
+                return bind(static_cast<parameter_names const&>(map), value.*members...);
+            }, map.members());
+        }
+
         sqlite3_stmt* stmt() const;
         sqlite3_stmt* any_stmt() const;
 
@@ -244,7 +461,11 @@ namespace sqnice {
                 }
             }
 
-            sqlite3_stmt* const   stmt;
+            // Resolved `parameter_names`, as pairs of (id, indexes):
+            using resolved_names = std::pair<unsigned, std::vector<int>>;
+
+            sqlite3_stmt* const         stmt;
+            std::vector<resolved_names> resolved_names_;
         private:
             const void* _Nullable owner_ = nullptr;
         };
@@ -255,6 +476,10 @@ namespace sqnice {
         ~statement() noexcept;
 
         std::shared_ptr<impl> give_impl(const void* _Nullable newOwner = nullptr);
+        /// True if an iterator or other object is using the statement.
+        bool in_use() const noexcept {
+            return impl_ && impl_->owned() && !impl_->owned_by(this);
+        }
         status check_bind(int rc, int idx);
         status bind_int(int idx, int value);
         status bind_int64(int idx, int64_t value);
@@ -269,7 +494,29 @@ namespace sqnice {
                 _bind_args(idx + 1, rest...);
         }
 
+        // Binds a value; if it's a string or blob, it's bound without copying.
+        template <typename T>
+        status _bind_uncopied(int idx, T const& v) {
+            using U = std::remove_cvref_t<T>;
+            if constexpr (std::is_same_v<U, const char*> || std::is_same_v<U, char*>) {
+                if (v == nullptr)
+                    return bind(idx, nullptr);
+                return bind(idx, uncopied_string(v));
+            } else if constexpr (std::is_convertible_v<U, std::string_view>
+                                 && !std::is_same_v<U, uncopied_string>) {
+                return bind(idx, uncopied_string(std::string_view(v)));
+            } else if constexpr (std::is_same_v<U, blob>) {
+                return bind(idx, uncopied_blob(v));
+            } else {
+                return bind(idx, v);
+            }
+        }
+
     private:
+        friend class database;
+        template <class> friend class statement_cache;
+        friend class bulk_inserter_base;
+        friend class row_stream_base;
         std::shared_ptr<impl> impl_;
     };
 
@@ -292,6 +539,81 @@ namespace sqnice {
     statement::bindref statement::operator[] (int idx)  {return bindref(*this, idx);}
 
 
+    /** A lightweight handle for executing a statement in a tight loop; returned by
+        `statement::fast()`. The statement is validated once, when the handle is created; the
+        database connection is kept open and the statement claimed (as though by an iterator)
+        until the handle is destructed, so the `statement`'s own methods can't be used
+        meanwhile.
+
+        Its methods skip the per-call checks `statement`'s methods make: no ownership checks,
+        no `weak_ptr` locks, and no exceptions. Errors are returned as `status` values and it's
+        up to you to check them. (Debug builds still assert that the handle is being used
+        correctly.) Column accessors have no bounds checks and must only be called after `step`
+        returns `status::row`.
+
+        Strings and blobs given to `bind` are _not_ copied, so they must remain valid until
+        the statement is stepped, reset or re-bound. */
+    class statement::fast_handle : noncopyable {
+    public:
+        ~fast_handle();
+
+        status bind(int idx, std::signed_integral auto v) noexcept {
+            if constexpr (sizeof(v) <= 4)
+                return bind_int(idx, v);
+            else
+                return bind_int64(idx, v);
+        }
+        status bind(int idx, std::unsigned_integral auto v) noexcept {
+            static_assert(sizeof(v) < 8, "uint64_t may not fit in a SQLite integer");
+            return bind_int64(idx, int64_t(v));
+        }
+        status bind(int idx, std::floating_point auto v) noexcept {return bind_double(idx, v);}
+        status bind(int idx, std::string_view) noexcept;
+        status bind(int idx, blob) noexcept;
+        status bind(int idx, nullptr_t) noexcept;
+
+        /// Clears all the parameter bindings to `NULL`.
+        void clear_bindings() noexcept;
+
+        /// Steps the statement: returns `row` if a result row is available, `done` when
+        /// finished, or an error.
+        status step() noexcept;
+
+        /// Steps a command, then resets it. Returns `ok` or an error.
+        status execute() noexcept;
+
+        /// Resets the statement so it can be stepped from the start. Bindings are unchanged.
+        void reset() noexcept;
+
+        /// The rowid of the most recent successful INSERT on this connection.
+        int64_t last_insert_rowid() const noexcept;
+        /// The number of rows changed by the last statement on this connection.
+        int changes() const noexcept;
+
+        // Column accessors for the current row:
+        int column_count() const noexcept;
+        data_type column_type(int idx) const noexcept;
+        int column_int(int idx) const noexcept;
+        int64_t column_int64(int idx) const noexcept;
+        double column_double(int idx) const noexcept;
+        std::string_view column_text(int idx) const noexcept;
+        std::span<const std::byte> column_blob(int idx) const noexcept;
+
+        fast_handle(fast_handle&&) noexcept;
+
+    private:
+        friend class statement;
+        explicit fast_handle(statement&);
+        status bind_int(int idx, int) noexcept;
+        status bind_int64(int idx, int64_t) noexcept;
+        status bind_double(int idx, double) noexcept;
+
+        db_handle                   db_;        // Keeps the connection open
+        std::shared_ptr<impl>       impl_;      // Owned by me while I exist
+        sqlite3_stmt*               stmt_;
+    };
+
+
     /** Produced by `statement::binder()`. Binds one statement parameter for each `<<` call.*/
     class statement::bindstream {
     public:
@@ -306,6 +628,22 @@ namespace sqnice {
     };
 
 
+    /** The concept `row_bindable` identifies custom types that `command::execute_many` can bind
+        as a whole row. Declaring a function `sqnice::bind_row_helper(statement&, T const&)` allows
+        the type T to be used; it should bind each parameter by calling `statement::bind()`. */
+    template <typename T>
+    concept row_bindable = requires(statement& stmt, T const& row) {
+        {bind_row_helper(stmt, row)} -> std::same_as<status>;
+    };
+
+    /** The concept `tuple_like` identifies types like `std::tuple`, `std::pair` and `std::array`,
+        whose elements `command::execute_many` binds to consecutive parameters. */
+    template <typename T>
+    concept tuple_like = requires {
+        std::tuple_size<std::remove_cvref_t<T>>::value;
+    };
+
+
     /** A SQL statement that does not return rows of results,
         i.e. `INSERT`, `UPDATE`, `CREATE`... anything other than `SELECT`. */
     class command : public statement {
@@ -336,6 +674,36 @@ namespace sqnice {
             return try_execute();
         }
 
+        /// Executes the statement once for each item of `rows`, all within a single transaction
+        /// (or a savepoint, if a transaction is already open); if any row fails, none of the
+        /// changes are kept. Each item is either `tuple_like`, whose elements are bound to
+        /// consecutive parameters, or `row_bindable`.
+        ///
+        /// This is considerably faster than calling `execute` in a loop. Strings and blobs in
+        /// the rows are bound without copying, since each item outlives the step that uses it.
+        /// Afterwards `changes` returns the total number of rows changed, and `last_insert_rowid`
+        /// the rowid of the last row inserted.
+        /// @param rows  An input range of tuple-like or `row_bindable` items.
+        /// @param rowids  If non-null, the rowid inserted by each row is appended to this vector.
+        template <std::ranges::input_range R>
+        status execute_many(R&& rows, std::vector<int64_t>* _Nullable rowids = nullptr) {
+            if (auto rc = begin_batch(); !ok(rc))
+                return rc;
+            status rc = status::ok;
+            try {
+                for (auto&& row : rows) {
+                    if (rc = _bind_row(row); !ok(rc))
+                        break;
+                    if (rc = step_batch(rowids); !ok(rc))
+                        break;
+                }
+            } catch (...) {
+                (void)finish_batch(status::error);  // roll back without throwing over the exception
+                throw;
+            }
+            return end_batch(rc);
+        }
+
         /// The last rowid inserted by this command, after executing it.
         int64_t last_insert_rowid() const noexcept          {return last_rowid_;}
 
@@ -343,8 +711,30 @@ namespace sqnice {
         int changes() const noexcept                        {return changes_;}
 
     private:
+        status begin_batch();
+        status step_batch(std::vector<int64_t>* _Nullable rowids) noexcept;
+        status end_batch(status);
+        status finish_batch(status) noexcept;
+
+        template <typename Row>
+        status _bind_row(Row const& row) {
+            if constexpr (row_bindable<Row>) {
+                return bind_row_helper(*this, row);
+            } else {
+                static_assert(tuple_like<Row>,
+                              "execute_many items must be tuple-like or row_bindable");
+                return std::apply([&](auto const&... cols) {
+                    status rc = status::ok;
+                    int idx = 1;
+                    ((ok(rc) ? (void)(rc = _bind_uncopied(idx++, cols)) : (void)0), ...);
+                    return rc;
+                }, row);
+            }
+        }
+
         int64_t last_rowid_ = -1;
         int     changes_ = 0;
+        bool    batch_txn_ = false;     // True if `begin_batch` began a transaction
     };
 
 
@@ -384,6 +774,11 @@ namespace sqnice {
         /// An empty iterator representing the end of the rows.
         [[nodiscard]] inline end_iterator end() const noexcept    {return end_iterator{};}
 
+        /// Runs the query and copies up to `max_rows` result rows into `batch`, replacing its
+        /// previous contents. Returns the number of rows fetched.
+        /// To fetch all the results in a series of batches, call `iterator::fetch_columns`.
+        size_t fetch_columns(column_batch& batch, size_t max_rows = SIZE_MAX);
+
         /// A convenience method that runs the query and returns the value of the first row's
         /// first column. If there are no rows, returns `std::nullopt`.
         template <typename T>
@@ -396,6 +791,26 @@ namespace sqnice {
 
         class row;
 
+        template <typename... Ts> class typed_rows;
+
+        /// Returns a range over the query's rows, each of which is a `std::tuple<Ts...>` of the
+        /// first `sizeof...(Ts)` column values, converted to those types. This is convenient
+        /// with structured bindings, like `for (auto [id, name] : q.as<int64_t, string_view>())`,
+        /// and faster than accessing columns one at a time, since the column count is checked
+        /// only once instead of on every access.
+        /// @note  Pointer-like values such as `string_view` are only valid until the next row.
+        /// @throws std::invalid_argument if the query has fewer than `sizeof...(Ts)` columns.
+        template <typename... Ts> [[nodiscard]] typed_rows<Ts...> as() &;
+        template <typename... Ts> [[nodiscard]] typed_rows<Ts...> as() &&;
+
+        /// Like `as`, but `std::pmr::string` and `std::pmr::vector<std::byte>` values are
+        /// allocated from `mr`. With a `std::pmr::monotonic_buffer_resource` this replaces a
+        /// heap allocation per value with a pointer bump, and a single bulk release later.
+        template <typename... Ts>
+        [[nodiscard]] typed_rows<Ts...> as(std::pmr::memory_resource& mr) &;
+        template <typename... Ts>
+        [[nodiscard]] typed_rows<Ts...> as(std::pmr::memory_resource& mr) &&;
+
     private:
         unsigned check_idx(unsigned idx) const;
     };
@@ -417,6 +832,10 @@ namespace sqnice {
         /// Returns the value of the `idx`th column as C++ type `T`.
         template <class T> T get(unsigned idx) const;
 
+        /// Returns the value of the `idx`th column as a `std::pmr::string` or
+        /// `std::pmr::vector<std::byte>` whose memory is allocated from `mr`.
+        template <pmr_column T> T get(unsigned idx, std::pmr::memory_resource& mr) const;
+
         class getstream;
         /// Returns a sort of input stream from which columns can be read using `>>`.
         [[nodiscard]] getstream getter(unsigned idx = 0) const noexcept;
@@ -425,10 +844,16 @@ namespace sqnice {
         friend class query;
         friend class query::iterator;
         friend class column_value;
+        template <typename...> friend class query::typed_rows;
+        friend class sqnice::row_stream_base;
 
         explicit row(sqlite3_stmt* stmt) noexcept       :stmt_(stmt) { }
         void clear()                                    {stmt_ = nullptr;}
 
+        // Returns the decoded value of a column without checking the index.
+        template <typename T> T unchecked_get(unsigned idx,
+                                              std::pmr::memory_resource* _Nullable) const;
+
     private:
         unsigned check_idx(unsigned idx) const;
 
@@ -490,6 +915,20 @@ namespace sqnice {
             return std::string(get<std::string_view>());
         }
         template<std::same_as<std::span<const std::byte>> T> T get() const noexcept;
+
+        /// Copies a text or blob value into a string or byte vector whose memory comes from
+        /// `mr`, such as a `std::pmr::monotonic_buffer_resource` that's released in bulk.
+        template<pmr_column T> T get(std::pmr::memory_resource& mr) const {
+            if constexpr (std::same_as<T, std::pmr::string>) {
+                return T(get<std::string_view>(), &mr);
+            } else {
+                auto bytes = get<std::span<const std::byte>>();
+                return T(bytes.begin(), bytes.end(), &mr);
+            }
+        }
+        template<pmr_column T> T get() const {
+            return get<T>(*std::pmr::get_default_resource());
+        }
         template<std::same_as<const void*> T> T get() const noexcept;
         template<std::same_as<blob> T> T get() const noexcept;
 
@@ -560,6 +999,11 @@ namespace sqnice {
         /// A convenience for accessing a column of the current row.
         column_value operator[] (unsigned idx) const    {return cur_row_[idx];}
 
+        /// Copies up to `max_rows` rows, starting with the current one, into `batch`, replacing
+        /// its previous contents, and advances the iterator past them. Returns the number of
+        /// rows fetched; if it's less than `max_rows`, the iterator has reached the end.
+        size_t fetch_columns(column_batch& batch, size_t max_rows);
+
         ~iterator() noexcept;
 
         using iterator_category = std::input_iterator_tag;
@@ -580,6 +1024,69 @@ namespace sqnice {
 
 
 
+    /** A range over a query's rows as tuples; returned by `query::as`. */
+    template <typename... Ts>
+    class query::typed_rows : noncopyable {
+    public:
+        using value_type = std::tuple<Ts...>;
+
+        class iterator {
+        public:
+            using iterator_category = std::input_iterator_tag;
+            using difference_type = std::ptrdiff_t;
+            using value_type = std::tuple<Ts...>;
+
+            /// Returns the current row's column values.
+            value_type operator*() const {
+                return decode(std::index_sequence_for<Ts...>{});
+            }
+
+            iterator& operator++()                      {++iter_; return *this;}
+
+            bool operator== (end_iterator) const        {return !iter_;}
+
+            /// The underlying query iterator, for access to `last_status` or other columns.
+            query::iterator const& base() const noexcept {return iter_;}
+
+        private:
+            friend class typed_rows;
+            iterator(query& q, std::pmr::memory_resource* _Nullable mr)
+            :iter_(q.begin()), mr_(mr) { }      // (iter_ can't be copied or moved)
+
+            template <size_t... I>
+            value_type decode(std::index_sequence<I...>) const {
+                query::row const& r = *iter_;
+                return value_type{r.template unchecked_get<Ts>(unsigned(I), mr_)...};
+            }
+
+            query::iterator                         iter_;
+            std::pmr::memory_resource* _Nullable    mr_;
+        };
+
+        /// Runs the query and returns an iterator pointing to the first result row.
+        [[nodiscard]] iterator begin() {
+            if (unsigned n = query_->column_count(); n < sizeof...(Ts)) [[unlikely]]
+                throw std::invalid_argument(format("query has %u columns, but as<> expects %u",
+                                                   n, unsigned(sizeof...(Ts))));
+            return iterator(*query_, mr_);
+        }
+
+        [[nodiscard]] end_iterator end() const noexcept {return end_iterator{};}
+
+    private:
+        friend class query;
+        typed_rows(query& q, std::pmr::memory_resource* _Nullable mr) noexcept
+        :query_(&q), mr_(mr) { }
+        typed_rows(query&& q, std::pmr::memory_resource* _Nullable mr) noexcept
+        :owned_(std::move(q)), query_(&*owned_), mr_(mr) { }
+        typed_rows(typed_rows&&) = delete;
+
+        std::optional<query>                    owned_; // Holds the query if `as` got an rvalue
+        query*                                  query_;
+        std::pmr::memory_resource* _Nullable    mr_;    // Allocates `pmr_column` values
+    };
+
+
     // some template & method implementations
 
     template <typename T>
@@ -613,8 +1120,73 @@ namespace sqnice {
     column_value query::row::operator[] (unsigned idx) const   {return column(idx);}
     template <class T> T query::row::get(unsigned idx) const   {return column(idx).get<T>();}
 
+    template <pmr_column T> T query::row::get(unsigned idx, std::pmr::memory_resource& mr) const {
+        return column(idx).get<T>(mr);
+    }
+
+    template <class T> T query::row::unchecked_get(unsigned idx,
+                                                   std::pmr::memory_resource* mr) const {
+        column_value col(*this, idx);
+        if constexpr (requires {typename T::value_type; requires std::same_as<T,
+                                            std::optional<typename T::value_type>>;}) {
+            if (col.not_null())
+                return unchecked_get<typename T::value_type>(idx, mr);
+            else
+                return std::nullopt;
+        } else if constexpr (pmr_column<T>) {
+            return mr ? col.get<T>(*mr) : col.get<T>();
+        } else {
+            return col.get<T>();
+        }
+    }
+
     query::iterator query::begin()                      {return iterator(this);}
 
+    template <typename... Ts> query::typed_rows<Ts...> query::as() & {
+        return typed_rows<Ts...>(*this, nullptr);
+    }
+
+    template <typename... Ts> query::typed_rows<Ts...> query::as() && {
+        return typed_rows<Ts...>(std::move(*this), nullptr);
+    }
+
+    template <typename... Ts>
+    query::typed_rows<Ts...> query::as(std::pmr::memory_resource& mr) & {
+        return typed_rows<Ts...>(*this, &mr);
+    }
+
+    template <typename... Ts>
+    query::typed_rows<Ts...> query::as(std::pmr::memory_resource& mr) && {
+        return typed_rows<Ts...>(std::move(*this), &mr);
+    }
+
+
+    // implementations of `database` SQL-literal template methods.
+
+    template <sql_literal SQL, typename... Args>
+    command& database::command(Args&&... args) {
+        static_assert(sizeof...(Args) == 0 || sizeof...(Args) == SQL.parameter_count(),
+                      "number of arguments doesn't match number of SQL parameters");
+        sqnice::command* cmd = &literal_command(literal_slot<SQL>(), SQL.view());
+        if (cmd->in_use()) [[unlikely]]
+            cmd = &cached_command(SQL.view());  // nested use; the cache can hold more instances
+        int idx = 1;
+        (cmd->bind(idx++, std::forward<Args>(args)), ...);
+        return *cmd;
+    }
+
+    template <sql_literal SQL, typename... Args>
+    query& database::query(Args&&... args) const {
+        static_assert(sizeof...(Args) == 0 || sizeof...(Args) == SQL.parameter_count(),
+                      "number of arguments doesn't match number of SQL parameters");
+        sqnice::query* q = &literal_query(literal_slot<SQL>(), SQL.view());
+        if (q->in_use()) [[unlikely]]
+            q = &cached_query(SQL.view());      // nested use; the cache can hold more instances
+        int idx = 1;
+        (q->bind(idx++, std::forward<Args>(args)), ...);
+        return *q;
+    }
+
     bool query::end_iterator::operator== (query::iterator const& i) const {
         return !i;
     }
@@ -0,0 +1,223 @@
+// sqnice/row_stream.hh
+//
+// The MIT License
+//
+// Copyright (c) 2015 Wongoo Lee (iwongu at gmail dot com)
+// Copyright (c) 2024 Jens Alfke (Github: snej)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#pragma once
+#ifndef SQNICE_ROW_STREAM_H
+#define SQNICE_ROW_STREAM_H
+
+#include "sqnice/query.hh"
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+ASSUME_NONNULL_BEGIN
+
+namespace sqnice {
+
+    /** Non-template base class of `row_stream`. It runs the producer thread and manages the
+        ring of batches; the subclass decodes rows into them. */
+    class row_stream_base : noncopyable {
+    public:
+        /// The status of the last step of the query: `done` after all rows were read, else an
+        /// error. (If exceptions are enabled, an error is thrown by the iterator instead.)
+        /// Only meaningful once iteration has ended.
+        status last_status() const noexcept             {return rc_;}
+
+    protected:
+        static constexpr size_t npos = SIZE_MAX;
+
+        row_stream_base(query&, size_t batch_rows, size_t max_batches, unsigned ncolumns);
+        ~row_stream_base();
+
+        /// Starts the producer thread. Called by the subclass constructor.
+        void start();
+        /// Cancels the producer thread and waits for it to exit, then resets the statement and
+        /// returns it to the query. Must be called by the subclass destructor.
+        void stop() noexcept;
+
+        /// Producer thread: fills the batch at index `slot` with up to `batch_rows_` rows.
+        /// Returns false when there are no more rows, or the stream has been cancelled.
+        virtual bool fill_batch(size_t slot) = 0;
+
+        /// Producer thread: steps to the next row, returning false at the end.
+        /// @throws database_error on error, if exceptions are enabled.
+        bool step();
+
+        /// Producer thread: true if the consumer has stopped the stream.
+        bool cancelled() const noexcept         {return cancelled_.load(std::memory_order_relaxed);}
+
+        /// Producer thread: decodes the current row.
+        template <typename... Ts, size_t... I>
+        std::tuple<Ts...> decode_row(std::index_sequence<I...>) const {
+            return std::tuple<Ts...>{row_.template unchecked_get<Ts>(unsigned(I), nullptr)...};
+        }
+
+        /// Consumer: waits for the next filled batch and returns its index, or `npos` at the end.
+        /// Rethrows any exception thrown by the producer thread.
+        size_t next_batch();
+        /// Consumer: returns the batch last returned by `next_batch` to the producer.
+        void release_batch();
+
+        size_t const batch_rows_;                   // Max rows per batch
+        size_t const max_batches_;                  // Number of batches in the ring
+
+    private:
+        void run() noexcept;
+
+        std::shared_ptr<statement::impl> impl_;     // The query's statement; I own it
+        query::row               row_;              // The current row (producer thread)
+        bool const               exceptions_;       // Does the query throw exceptions?
+        status                   rc_ = status::ok;  // Last status from sqlite3_step
+        std::mutex               mutex_;            // Guards the members below
+        std::condition_variable  cond_;             // Signals changes to the members below
+        size_t                   head_ = 0;         // Index of the consumer's next batch
+        size_t                   count_ = 0;        // Number of filled batches
+        bool                     finished_ = false; // Producer thread has exited
+        std::exception_ptr       error_;            // Exception thrown by the producer
+        std::atomic<bool>        cancelled_ = false;// Set by `stop`
+        std::thread              thread_;           // The producer thread
+    };
+
+
+    /** Streams a query's rows from a helper thread, so that SQLite's work on the next rows
+        overlaps the caller's work on the current ones.
+
+        The helper thread runs the query, decoding rows as `std::tuple<Ts...>` into batches of
+        `batch_rows` rows each, held in a ring of `max_batches` batches. It waits whenever
+        the ring is full, so at most `batch_rows * max_batches` rows are buffered. The stream
+        itself is an input range of those tuples, which may be moved from.
+
+        The stream takes ownership of the query's statement, like an iterator; until it's
+        destructed, using the query throws `std::logic_error`. Destructing the stream before
+        the end stops the helper thread and resets the query.
+
+        @warning  While the stream exists, the query's database is in use on another thread.
+                  The caller must not use it, nor any statements created from it.
+        @tparam Ts  The C++ types of the columns. These must own their values, i.e. `std::string`
+                    not `std::string_view`, since the rows are read after SQLite moves on. */
+    template <owned_column... Ts>
+    class row_stream : public row_stream_base {
+    public:
+        using value_type = std::tuple<Ts...>;
+
+        /// Starts streaming the rows of a query, whose parameters should already be bound.
+        /// @throws std::logic_error if the query is already being iterated.
+        /// @throws std::invalid_argument if the query has fewer than `sizeof...(Ts)` columns.
+        explicit row_stream(query& q, size_t batch_rows = 256, size_t max_batches = 4)
+        :row_stream_base(q, batch_rows, max_batches, unsigned(sizeof...(Ts)))
+        ,ring_(max_batches_)
+        {
+            for (auto& batch : ring_)
+                batch.reserve(batch_rows_);
+            start();
+        }
+
+        ~row_stream()                                   {stop();}
+
+        class iterator {
+        public:
+            using iterator_category = std::input_iterator_tag;
+            using difference_type = std::ptrdiff_t;
+            using value_type = std::tuple<Ts...>;
+
+            /// The current row. It may be moved from.
+            value_type& operator*() const noexcept      {return (*batch_)[pos_];}
+            value_type* operator->() const noexcept     {return &(*batch_)[pos_];}
+
+            iterator& operator++() {
+                if (++pos_ >= batch_->size())
+                    stream_->next(*this);
+                return *this;
+            }
+
+            bool operator== (query::end_iterator) const noexcept {return batch_ == nullptr;}
+
+        private:
+            friend class row_stream;
+            explicit iterator(row_stream* s)            :stream_(s) { }
+
+            row_stream*                             stream_;
+            std::vector<value_type>* _Nullable      batch_ = nullptr;
+            size_t                                  pos_ = 0;
+        };
+
+        /// Returns an iterator at the first row. Blocks until it's available.
+        /// @throws std::logic_error if called more than once.
+        [[nodiscard]] iterator begin() {
+            if (begun_) [[unlikely]]
+                throw std::logic_error("row_stream can only be iterated once");
+            begun_ = true;
+            iterator i(this);
+            next(i);
+            return i;
+        }
+
+        [[nodiscard]] query::end_iterator end() const noexcept {return query::end_iterator{};}
+
+    private:
+        // Moves `i` to the start of the next non-empty batch, or to the end.
+        void next(iterator& i) {
+            if (i.batch_)
+                release_batch();
+            while (true) {
+                size_t slot = next_batch();
+                if (slot == npos) {
+                    i.batch_ = nullptr;
+                    return;
+                } else if (!ring_[slot].empty()) {
+                    i.batch_ = &ring_[slot];
+                    i.pos_ = 0;
+                    return;
+                }
+                release_batch();
+            }
+        }
+
+        bool fill_batch(size_t slot) override {
+            std::vector<value_type>& batch = ring_[slot];
+            batch.clear();
+            while (batch.size() < batch_rows_) {
+                if (cancelled() || !step())
+                    return false;
+                batch.push_back(this->template decode_row<Ts...>(std::index_sequence_for<Ts...>{}));
+            }
+            return true;
+        }
+
+        std::vector<std::vector<value_type>>    ring_;          // The batches
+        bool                                    begun_ = false; // Has `begin` been called?
+    };
+
+}
+
+ASSUME_NONNULL_END
+
+#endif
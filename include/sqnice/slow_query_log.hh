@@ -0,0 +1,117 @@
+// sqnice/slow_query_log.hh
+//
+// The MIT License
+//
+// Copyright (c) 2015 Wongoo Lee (iwongu at gmail dot com)
+// Copyright (c) 2024 Jens Alfke (Github: snej)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#pragma once
+#ifndef SQNICE_SLOW_QUERY_LOG_H
+#define SQNICE_SLOW_QUERY_LOG_H
+
+#include "sqnice/database.hh"
+#include <chrono>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+ASSUME_NONNULL_BEGIN
+
+namespace sqnice {
+
+    /** A statement that took at least a `slow_query_log`'s threshold to run. */
+    struct slow_query {
+        std::string                             sql;        ///< SQL with bound parameter values
+        std::chrono::nanoseconds                duration;   ///< How long it took to run
+        std::chrono::system_clock::time_point   when;       ///< When it finished
+    };
+
+
+    /** Latency statistics of the statements with the same "shape": SQL that's identical after
+        literal values are replaced with `?` and whitespace is collapsed. */
+    struct query_shape_stats {
+        std::string                 shape;          ///< The normalized SQL
+        uint64_t                    count = 0;      ///< Number of times run
+        uint64_t                    slow_count = 0; ///< Number of times it was slow
+        std::chrono::nanoseconds    total {};       ///< Total time spent running
+        std::chrono::nanoseconds    p50 {};         ///< Median time
+        std::chrono::nanoseconds    p99 {};         ///< 99th percentile time
+        std::chrono::nanoseconds    max {};         ///< Longest time
+        std::string                 plan;           ///< `EXPLAIN QUERY PLAN` of a slow instance
+    };
+
+
+    /** Records the latency of every statement run by one or more databases, using their
+        `profile_handler`s, and logs the slow ones.
+
+        - Every statement's latency is added to a histogram for its shape (see
+          `query_shape_stats`.) This costs a hash lookup, under a mutex, plus a few atomic adds.
+        - A statement that takes at least `threshold` is also added to a list of recent slow
+          queries, with its parameter values.
+        - The first time a shape is slow, the log runs `EXPLAIN QUERY PLAN` on it, on the same
+          connection, and saves the result.
+
+        The log may be attached to several databases, e.g. every connection in a `pool`, and
+        its methods may be called on any thread. It can be destructed before the databases
+        it's attached to; they keep its internal state alive. */
+    class slow_query_log : noncopyable {
+    public:
+        using duration = std::chrono::nanoseconds;
+
+        /// Constructs a log.
+        /// @param threshold  Statements taking at least this long are logged as slow.
+        /// @param max_slow_queries  The maximum number of recent slow queries remembered.
+        explicit slow_query_log(duration threshold = std::chrono::milliseconds(100),
+                                size_t max_slow_queries = 100);
+
+        /// Starts recording the statements run by `db`, by setting its profile handler.
+        /// If `db` already has a profile handler, such as another log's, it's still called.
+        /// (Call `db.set_profile_handler(nullptr)` to stop; that detaches every handler.)
+        void attach(database& db);
+
+        /// The duration at or above which a statement counts as slow.
+        duration threshold() const noexcept;
+        void set_threshold(duration) noexcept;
+
+        /// The most recent slow queries, oldest first.
+        std::vector<slow_query> slow_queries() const;
+
+        /// Statistics of every statement shape seen, sorted by descending total time.
+        std::vector<query_shape_stats> shapes() const;
+
+        /// Forgets all slow queries and shape statistics.
+        void clear();
+
+        /// Normalizes SQL to its "shape", by replacing string, blob and numeric literals with
+        /// `?` and collapsing whitespace.
+        static std::string normalize_sql(std::string_view sql);
+
+    private:
+        class state;
+        std::shared_ptr<state> state_;
+    };
+
+}
+
+ASSUME_NONNULL_END
+
+#endif
@@ -0,0 +1,143 @@
+// sqnice/sql_literal.hh
+//
+// The MIT License
+//
+// Copyright (c) 2015 Wongoo Lee (iwongu at gmail dot com)
+// Copyright (c) 2024 Jens Alfke (Github: snej)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#pragma once
+#ifndef SQNICE_SQL_LITERAL_H
+#define SQNICE_SQL_LITERAL_H
+
+#include "sqnice/base.hh"
+#include <cstddef>
+#include <string_view>
+
+ASSUME_NONNULL_BEGIN
+
+namespace sqnice {
+
+    /** Counts the parameters in a SQL statement at compile time, following SQLite's rules:
+        `?` is numbered one higher than the largest number used so far, `?NNN` is numbered NNN,
+        and a named parameter (`:aaa`, `@aaa`, `$aaa`) gets the next number unless the same name
+        appeared earlier. The result is the largest parameter number, which is what
+        `statement::parameter_count` returns. */
+    consteval int count_sql_parameters(std::string_view sql) {
+        auto is_digit = [](char c) {return c >= '0' && c <= '9';};
+        auto is_ident = [&](char c) {
+            return is_digit(c) || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_'
+                || (unsigned char)c >= 0x80;
+        };
+        // Returns the position just past the token starting at `i` that isn't a parameter,
+        // or `i` itself if there's a parameter there:
+        auto skip = [&](size_t i) -> size_t {
+            char c = sql[i];
+            if (c == '\'' || c == '"' || c == '`' || c == '[') {
+                char close = (c == '[') ? ']' : c;
+                size_t end = sql.find(close, i + 1);
+                return end == std::string_view::npos ? sql.size() : end + 1;
+            } else if (sql.substr(i, 2) == "--") {
+                size_t end = sql.find('\n', i);
+                return end == std::string_view::npos ? sql.size() : end + 1;
+            } else if (sql.substr(i, 2) == "/*") {
+                size_t end = sql.find("*/", i + 2);
+                return end == std::string_view::npos ? sql.size() : end + 2;
+            } else if (c == '?' || c == ':' || c == '@' || c == '$') {
+                return i;
+            } else {
+                return i + 1;
+            }
+        };
+        // Returns the length of the parameter token at `i`:
+        auto param_len = [&](size_t i) -> size_t {
+            size_t j = i + 1;
+            if (sql[i] == '?') {
+                while (j < sql.size() && is_digit(sql[j]))
+                    ++j;
+            } else {
+                while (j < sql.size() && is_ident(sql[j]))
+                    ++j;
+            }
+            return j - i;
+        };
+
+        int highest = 0;
+        for (size_t i = 0; i < sql.size(); ) {
+            if (size_t next = skip(i); next != i) {
+                i = next;
+                continue;
+            }
+            std::string_view param = sql.substr(i, param_len(i));
+            if (param[0] == '?') {
+                if (param.size() == 1) {
+                    ++highest;
+                } else {
+                    int n = 0;
+                    for (char c : param.substr(1))
+                        n = 10 * n + (c - '0');
+                    highest = (n > highest) ? n : highest;
+                }
+            } else {
+                // Named parameter: it only gets a new number if it hasn't appeared before.
+                bool seen = false;
+                for (size_t j = 0; j < i && !seen; ) {
+                    if (size_t next = skip(j); next != j) {
+                        j = next;
+                    } else {
+                        size_t len = param_len(j);
+                        seen = (sql.substr(j, len) == param);
+                        j += len;
+                    }
+                }
+                if (!seen)
+                    ++highest;
+            }
+            i += param.size();
+        }
+        return highest;
+    }
+
+
+    /** A SQL string literal that can be passed as a template parameter, as in
+        `db.query<"SELECT name FROM users WHERE id=?">(id)`.
+        Its parameter count is known at compile time, and each distinct literal gets its own
+        process-wide slot number, which `database` uses to look up its compiled statement. */
+    template <size_t N>
+    struct sql_literal {
+        consteval sql_literal(const char (&str)[N]) {   // NOLINT(*-explicit-constructor)
+            for (size_t i = 0; i < N; ++i)
+                chars[i] = str[i];
+        }
+
+        /// The SQL string.
+        constexpr std::string_view view() const         {return {chars, N - 1};}
+
+        /// The number of parameters in the SQL statement.
+        consteval int parameter_count() const           {return count_sql_parameters(view());}
+
+        char chars[N] {};
+    };
+
+}
+
+ASSUME_NONNULL_END
+
+#endif
@@ -30,10 +30,16 @@
 // Umbrella header that includes the sqnice headers.
 
 #include "sqnice/blob_stream.hh"
+#include "sqnice/bulk_insert.hh"
+#include "sqnice/column_batch.hh"
 #include "sqnice/database.hh"
 #include "sqnice/functions.hh"
+#include "sqnice/latency_histogram.hh"
 #include "sqnice/pool.hh"
 #include "sqnice/query.hh"
+#include "sqnice/row_stream.hh"
+#include "sqnice/slow_query_log.hh"
 #include "sqnice/transaction.hh"
+#include "sqnice/workload.hh"
 
 #endif
@@ -0,0 +1,179 @@
+// sqnice/workload.hh
+//
+// The MIT License
+//
+// Copyright (c) 2015 Wongoo Lee (iwongu at gmail dot com)
+// Copyright (c) 2024 Jens Alfke (Github: snej)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#pragma once
+#ifndef SQNICE_WORKLOAD_H
+#define SQNICE_WORKLOAD_H
+
+#include "sqnice/database.hh"
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <variant>
+#include <vector>
+
+ASSUME_NONNULL_BEGIN
+
+namespace sqnice {
+
+    /** A parameter value bound to a recorded statement. */
+    using workload_value = std::variant<nullptr_t, int64_t, double, std::string,
+                                        std::vector<std::byte>>;
+
+
+    /** One statement execution read from a workload log. */
+    struct workload_event {
+        uint64_t                    sequence = 0;   ///< Order in which the statement finished
+        unsigned                    connection = 0; ///< ID the recorder gave the connection
+        std::string_view            sql;            ///< The statement's SQL, with placeholders
+        std::vector<workload_value> params;         ///< Bound values; index 0 is parameter 1
+        std::chrono::nanoseconds    start {};       ///< When it started, since recording began
+        std::chrono::nanoseconds    duration {};    ///< How long it took to run
+        bool                        replayable = true; ///< False if `params` couldn't be recorded
+    };
+
+
+    /** Records every statement run by one or more databases to a compact binary log: the SQL,
+        the bound parameter values, which connection ran it, when it started, and how long it
+        took, to the nanosecond. Transactions appear as the statements that begin and end them
+        (`BEGIN`, `SAVEPOINT`, `COMMIT`...). The log can be read with `workload_reader`, and
+        re-run against a copy of the database with `replay_workload` or the `sqnice_replay`
+        tool.
+
+        Recording uses each database's `profile_handler`, so it sees every statement, including
+        those run through `fast_handle`, `bulk_inserter` and `execute`. Events are logged in
+        the order the statements finish, and numbered in that order by their `sequence`.
+        Each distinct SQL string is written only once.
+
+        Parameter values are captured exactly as they're bound, by `statement` and `fast_handle`.
+        For a statement that was bound before the recorder was created, they're recovered from
+        `sqlite3_expanded_sql` instead, which only keeps 15 significant digits of floating-point
+        values. If a value can't be recorded at all, such as a pointer bound with `bind_pointer`,
+        the event is logged as not `replayable`. (Values bound directly through the SQLite API
+        aren't seen.) While any recorder exists, every bind call in the process pays for a map
+        lookup under a mutex.
+
+        The recorder may be attached to several databases, e.g. every connection in a `pool`,
+        and used from any thread. The log file stays open until the recorder and every
+        database it's attached to have been destructed (or detached.) */
+    class workload_recorder : noncopyable {
+    public:
+        /// Creates the log file, replacing any existing file.
+        /// @throws database_error if the file can't be created.
+        explicit workload_recorder(std::string_view path);
+
+        ~workload_recorder();
+
+        /// Starts recording the statements run by `db`, by setting its profile handler.
+        /// If `db` already has a profile handler, such as another log's, it's still called.
+        /// (Call `db.set_profile_handler(nullptr)` to stop; that detaches every handler.)
+        /// @returns  The connection ID that will identify `db` in the log.
+        unsigned attach(database& db);
+
+        /// Writes buffered events to the file.
+        /// @throws database_error if writing to the file has failed.
+        void flush();
+
+        /// The number of statements recorded so far.
+        uint64_t event_count() const noexcept;
+
+    private:
+        class state;
+        std::shared_ptr<state> state_;
+    };
+
+
+    /** Reads a log file written by `workload_recorder`. */
+    class workload_reader : noncopyable {
+    public:
+        /// Opens a log file.
+        /// @throws database_error if the file can't be opened or isn't a workload log.
+        explicit workload_reader(std::string_view path);
+
+        ~workload_reader();
+
+        /// Reads the next event into `event`, returning false at the end of the log. The event's
+        /// `sql` remains valid as long as the reader exists.
+        /// @throws database_error if the log is corrupt.
+        bool next(workload_event& event);
+
+    private:
+        uint8_t read_byte();
+        uint64_t read_varint();
+        void read_bytes(void* dst, size_t size);
+
+        FILE*                       file_;
+        std::deque<std::string>     sqls_;      // Indexed by SQL ID
+    };
+
+
+    /** Options for `replay_workload`. */
+    struct replay_options {
+        /// If true, each connection runs its statements at the same offsets from the start as
+        /// they originally ran, on its own thread; but a statement also waits until every
+        /// statement that finished before it originally started has been replayed, so it sees
+        /// the same data. (Statements that originally overlapped may still interleave
+        /// differently.) If false (the default), all statements run one after another, on the
+        /// calling thread, as fast as possible, in the order in which they originally finished;
+        /// this is deterministic.
+        bool original_timing = false;
+
+        /// Called after each replay connection is opened, e.g. to change its settings with
+        /// `PRAGMA`s for an A/B comparison.
+        std::function<void (database&)> on_open;
+
+        /// Called after each statement is replayed, with the time it took and its status.
+        /// (Calls are serialized, even when replaying with `original_timing`.)
+        std::function<void (workload_event const&, std::chrono::nanoseconds, status)>
+            on_statement;
+    };
+
+    /** The outcome of `replay_workload`. */
+    struct replay_result {
+        uint64_t                    statements = 0;     ///< Number of statements run
+        uint64_t                    errors = 0;         ///< Number that failed
+        uint64_t                    skipped = 0;        ///< Number not `replayable`, not run
+        std::chrono::nanoseconds    elapsed {};         ///< Total time taken
+    };
+
+    /// Re-runs the statements in a workload log against the database file at `db_path`,
+    /// which should be a copy of the recorded database as it was when recording started.
+    /// Each recorded connection is replayed on its own `database` connection. Events that
+    /// aren't `replayable` are skipped, without calling `on_statement`.
+    /// @throws database_error if the log can't be read or the database can't be opened.
+    replay_result replay_workload(std::string_view log_path,
+                                  std::string_view db_path,
+                                  replay_options const& = {});
+
+}
+
+ASSUME_NONNULL_END
+
+#endif
@@ -78,6 +78,7 @@ namespace sqnice {
     static_assert(int(limit::sql_length)        == SQLITE_LIMIT_SQL_LENGTH);
     static_assert(int(limit::columns)           == SQLITE_LIMIT_COLUMN);
     static_assert(int(limit::function_args)     == SQLITE_LIMIT_FUNCTION_ARG);
+    static_assert(int(limit::variables)         == SQLITE_LIMIT_VARIABLE_NUMBER);
     static_assert(int(limit::worker_threads)    == SQLITE_LIMIT_WORKER_THREADS);
 
     static_assert(int(function_flags::deterministic) == SQLITE_DETERMINISTIC);
@@ -0,0 +1,81 @@
+// sqnice/bind_capture.hh
+//
+// The MIT License
+//
+// Copyright (c) 2015 Wongoo Lee (iwongu at gmail dot com)
+// Copyright (c) 2024 Jens Alfke (Github: snej)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#pragma once
+#ifndef SQNICE_BIND_CAPTURE_H
+#define SQNICE_BIND_CAPTURE_H
+
+#include "sqnice/workload.hh"
+#include <atomic>
+#include <vector>
+
+ASSUME_NONNULL_BEGIN
+
+struct sqlite3_stmt;
+
+namespace sqnice {
+
+    /** Hooks through which `statement` and `statement::fast_handle` report the values bound to
+        their parameters, so `workload_recorder` can log them exactly. They do nothing unless a
+        recorder exists; then they keep each statement's current bindings in a global table.
+        (Implemented in workload.cc.) */
+    class bind_capture {
+    public:
+        /// True if bindings are being captured. Check this before calling the other methods.
+        static bool active() noexcept   {return sActive.load(std::memory_order_relaxed) > 0;}
+
+        /// A statement was compiled; all its parameters are NULL.
+        static void prepared(sqlite3_stmt*) noexcept;
+        /// A value was bound to a parameter.
+        static void bound(sqlite3_stmt*, int idx, workload_value) noexcept;
+        /// A value that can't be recorded, such as a pointer, was bound to a parameter.
+        static void bound_unrecordable(sqlite3_stmt*, int idx) noexcept;
+        /// All parameters were set to NULL by `sqlite3_clear_bindings`.
+        static void cleared(sqlite3_stmt*) noexcept;
+        /// The statement was finalized.
+        static void finalized(sqlite3_stmt*) noexcept;
+
+        enum result {
+            complete,       ///< Every parameter's value is known
+            incomplete,     ///< Some parameters were bound while nothing was being captured
+            unrecordable,   ///< Some parameter's value can't be recorded
+        };
+
+        /// Copies a statement's current bindings into `params`.
+        static result get(sqlite3_stmt*, std::vector<workload_value>& params);
+
+        /// Called by each recorder when it's created and destroyed.
+        static void start() noexcept;
+        static void stop() noexcept;
+
+    private:
+        static inline std::atomic<int> sActive = 0;     // Number of recorders
+    };
+
+}
+
+ASSUME_NONNULL_END
+
+#endif
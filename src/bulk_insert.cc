@@ -0,0 +1,102 @@
+// sqnice/bulk_insert.cc
+//
+// The MIT License
+//
+// Copyright (c) 2015 Wongoo Lee (iwongu at gmail dot com)
+// Copyright (c) 2024 Jens Alfke (Github: snej)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include "sqnice/bulk_insert.hh"
+#include "sqnice/database.hh"
+#include <stdexcept>
+
+namespace sqnice {
+    using namespace std;
+
+    bulk_inserter_base::bulk_inserter_base(database& db,
+                                           string_view table,
+                                           vector<string> columns,
+                                           string_view on_conflict)
+    :db_(db)
+    ,table_(table)
+    ,columns_(std::move(columns))
+    ,on_conflict_(on_conflict)
+    {
+        if (columns_.empty())
+            throw invalid_argument("bulk_inserter: no columns");
+        rows_per_chunk_ = db_.get_limit(limit::variables) / columns_.size();
+        if (rows_per_chunk_ == 0)
+            throw invalid_argument("bulk_inserter: too many columns for one statement");
+    }
+
+    bulk_inserter_base::~bulk_inserter_base() = default;
+
+    string bulk_inserter_base::sql_for(size_t nrows) const {
+        string sql = "INSERT INTO " + table_ + " (";
+        for (size_t i = 0; i < columns_.size(); ++i) {
+            if (i > 0) sql += ", ";
+            sql += columns_[i];
+        }
+        sql += ") VALUES ";
+
+        string row = "(?";
+        for (size_t i = 1; i < columns_.size(); ++i)
+            row += ",?";
+        row += ')';
+        sql.reserve(sql.size() + nrows * (row.size() + 1) + on_conflict_.size() + 1);
+        for (size_t i = 0; i < nrows; ++i) {
+            if (i > 0) sql += ',';
+            sql += row;
+        }
+        if (!on_conflict_.empty()) {
+            sql += ' ';
+            sql += on_conflict_;
+        }
+        return sql;
+    }
+
+    command& bulk_inserter_base::chunk_command(size_t nrows) {
+        assert(nrows > 0 && nrows <= rows_per_chunk_);
+        if (nrows == rows_per_chunk_) {
+            if (!full_chunk_)
+                full_chunk_ = make_unique<command>(db_, sql_for(nrows), statement::persistent);
+            return *full_chunk_;
+        } else {
+            // Not cached by the database, since each size would push out a user's statement:
+            if (!remainder_ || remainder_rows_ != nrows) {
+                remainder_ = make_unique<command>(db_, sql_for(nrows));
+                remainder_rows_ = nrows;
+            }
+            return *remainder_;
+        }
+    }
+
+    status bulk_inserter_base::execute_chunk(command& cmd, size_t nrows, clock::time_point start) {
+        status rc = cmd.execute();
+        if (ok(rc)) {
+            stats_.rows += nrows;
+            stats_.statements += 1;
+            stats_.changes += cmd.changes();
+        }
+        stats_.elapsed += chrono::duration_cast<chrono::nanoseconds>(clock::now() - start);
+        return rc;
+    }
+
+}
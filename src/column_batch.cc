@@ -0,0 +1,120 @@
+// sqnice/column_batch.cc
+//
+// The MIT License
+//
+// Copyright (c) 2015 Wongoo Lee (iwongu at gmail dot com)
+// Copyright (c) 2024 Jens Alfke (Github: snej)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include "sqnice/column_batch.hh"
+#include <cstring>
+
+#ifdef SQNICE_LOADABLE_EXTENSION
+#  include <sqlite3ext.h>
+SQLITE_EXTENSION_INIT1
+#else
+#  include <sqlite3.h>
+#endif
+
+namespace sqnice {
+    using namespace std;
+
+
+    void column_batch::clear() noexcept {
+        for (column& col : columns_)
+            col.clear();
+        rows_ = 0;
+    }
+
+    void column_batch::start(unsigned ncolumns) {
+        if (columns_.size() != ncolumns)
+            columns_.resize(ncolumns);
+        clear();
+    }
+
+    void column_batch::append_row(sqlite3_stmt* stmt) {
+        int idx = 0;
+        for (column& col : columns_)
+            col.append(stmt, idx++, rows_);
+        ++rows_;
+    }
+
+
+    void column_batch::column::clear() noexcept {
+        nulls_.clear();
+        ints_.clear();
+        doubles_.clear();
+        offsets_.clear();
+        data_.clear();
+        if (type_ == data_type::text || type_ == data_type::blob)
+            offsets_.push_back(0);  // (can't throw; capacity was already allocated)
+    }
+
+    // Sets the column's type, once its first non-null value appears in row `rows`.
+    // Backfills the earlier (null) rows with placeholder values.
+    void column_batch::column::set_type(data_type type, size_t rows) {
+        type_ = type;
+        switch (type) {
+            case data_type::integer:        ints_.assign(rows, 0); break;
+            case data_type::floating_point: doubles_.assign(rows, 0.0); break;
+            default:                        offsets_.assign(rows + 1, 0); break;
+        }
+    }
+
+    // Appends the value of column `idx` of the current row. The caller must hold the database
+    // mutex, since it accesses the column value with the `sqlite3_value_*` functions.
+    void column_batch::column::append(sqlite3_stmt* stmt, int idx, size_t row) {
+        sqlite3_value* value = sqlite3_column_value(stmt, idx);
+        auto type = data_type{sqlite3_value_type(value)};
+        if (row % 64 == 0)
+            nulls_.push_back(0);
+        if (type == data_type::null)
+            nulls_.back() |= uint64_t(1) << (row % 64);
+        else if (type_ == data_type::null) [[unlikely]]
+            set_type(type, row);
+
+        switch (type_) {
+            case data_type::null:
+                break;
+            case data_type::integer:
+                ints_.push_back(sqlite3_value_int64(value));
+                break;
+            case data_type::floating_point:
+                doubles_.push_back(sqlite3_value_double(value));
+                break;
+            case data_type::text:
+            case data_type::blob: {
+                if (type != data_type::null) {
+                    // Get the pointer before the size, so the size is of the converted value:
+                    const void* src = (type_ == data_type::text) ? sqlite3_value_text(value)
+                                                                 : sqlite3_value_blob(value);
+                    size_t size = sqlite3_value_bytes(value);
+                    size_t pos = data_.size();
+                    data_.resize(pos + size);
+                    if (size > 0)
+                        ::memcpy(data_.data() + pos, src, size);
+                }
+                offsets_.push_back(data_.size());
+                break;
+            }
+        }
+    }
+
+}
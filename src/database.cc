@@ -30,9 +30,12 @@
 #include "statement_cache.hh"
 #include <cstdio>
 #include <cstring>
+#include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <filesystem>
 #include <mutex>
+#include <unordered_map>
 #include <utility>
 
 #ifdef SQNICE_LOADABLE_EXTENSION
@@ -69,11 +72,13 @@ namespace sqnice {
     database::database(database&& db) noexcept
     : checking(db.exceptions_)
     , db_(std::move(db.db_))
+    , stmt_cache_capacity_(db.stmt_cache_capacity_)
     , bh_(std::move(db.bh_))
     , ch_(std::move(db.ch_))
     , rh_(std::move(db.rh_))
     , uh_(std::move(db.uh_))
     , ah_(std::move(db.ah_))
+    , ph_(std::move(db.ph_))
     {
         weak_db_ = db_;
         db.weak_db_ = {};
@@ -81,14 +86,18 @@ namespace sqnice {
 
     database& database::operator=(database&& db) noexcept {
         static_cast<checking&>(*this) = static_cast<checking&&>(db);
+        if (ph_ && db_)
+            sqlite3_trace_v2(db_.get(), 0, nullptr, nullptr);   // its context is about to go
         set_db(db.db_);
         set_db(std::move(db.db_));
         db.weak_db_ = {};
+        stmt_cache_capacity_ = db.stmt_cache_capacity_;
         bh_ = std::move(db.bh_);
         ch_ = std::move(db.ch_);
         rh_ = std::move(db.rh_);
         uh_ = std::move(db.uh_);
         ah_ = std::move(db.ah_);
+        ph_ = std::move(db.ph_);
 
         return *this;
     }
@@ -201,11 +210,14 @@ namespace sqnice {
     void database::tear_down() noexcept {
         commands_.reset();
         queries_.reset();
+        literal_commands_.clear();
+        literal_queries_.clear();
         set_busy_handler(nullptr);
         set_commit_handler(nullptr);
         set_rollback_handler(nullptr);
         set_update_handler(nullptr);
         set_authorize_handler(nullptr);
+        set_profile_handler(nullptr);
     }
 
     status database::close_and_delete() {
@@ -257,14 +269,88 @@ namespace sqnice {
 
     command database::command(string_view sql) {
         if (!commands_)
-            commands_ = make_unique<command_cache>(*this);
-        return commands_->compile(string(sql));
+            commands_ = make_unique<command_cache>(*this, stmt_cache_capacity_);
+        return commands_->compile(sql);
+    }
+
+    command& database::cached_command(string_view sql) {
+        if (!commands_)
+            commands_ = make_unique<command_cache>(*this, stmt_cache_capacity_);
+        return commands_->borrow(sql);
     }
 
     query database::query(string_view sql) const {
         if (!queries_)
-            queries_ = make_unique<query_cache>(const_cast<database&>(*this));
-        return queries_->compile(string(sql));
+            queries_ = make_unique<query_cache>(const_cast<database&>(*this), stmt_cache_capacity_);
+        return queries_->compile(sql);
+    }
+
+    query& database::cached_query(string_view sql) const {
+        if (!queries_)
+            queries_ = make_unique<query_cache>(const_cast<database&>(*this), stmt_cache_capacity_);
+        return queries_->borrow(sql);
+    }
+
+    unsigned database::new_literal_slot() noexcept {
+        static atomic<unsigned> sNextSlot = 0;
+        return sNextSlot++;
+    }
+
+    command& database::compile_literal_command(unsigned slot, string_view sql) {
+        if (slot >= literal_commands_.size())
+            literal_commands_.resize(slot + 1);
+        literal_commands_[slot] = make_unique<sqnice::command>(*this, sql, statement::persistent);
+        return *literal_commands_[slot];
+    }
+
+    query& database::compile_literal_query(unsigned slot, string_view sql) const {
+        if (slot >= literal_queries_.size())
+            literal_queries_.resize(slot + 1);
+        literal_queries_[slot] = make_unique<sqnice::query>(*this, sql, statement::persistent);
+        return *literal_queries_[slot];
+    }
+
+    void database::set_statement_cache_capacity(size_t capacity) {
+        stmt_cache_capacity_ = capacity;
+        if (commands_)
+            commands_->set_capacity(capacity);
+        if (queries_)
+            queries_->set_capacity(capacity);
+    }
+
+    statement_cache_stats database::command_cache_stats() const noexcept {
+        if (commands_)
+            return commands_->stats();
+        return {.capacity = stmt_cache_capacity_};
+    }
+
+    statement_cache_stats database::query_cache_stats() const noexcept {
+        if (queries_)
+            return queries_->stats();
+        return {.capacity = stmt_cache_capacity_};
+    }
+
+    vector<statement_report_entry> database::statement_report(bool reset) const {
+        vector<statement_report_entry> report;
+        unordered_map<string_view, size_t> index;   // SQL -> index in `report`
+        auto add = [&](statement const& stmt) {
+            auto [i, added] = index.try_emplace(stmt.sql(), report.size());
+            if (added)
+                report.push_back({.sql = string(stmt.sql())});
+            statement_report_entry& entry = report[i->second];
+            ++entry.instances;
+            entry.stats += stmt.stats(reset);
+        };
+        if (commands_)
+            commands_->each_statement(add);
+        if (queries_)
+            queries_->each_statement(add);
+        for (auto& cmd : literal_commands_)
+            if (cmd) add(*cmd);
+        for (auto& qry : literal_queries_)
+            if (qry) add(*qry);
+        ranges::stable_sort(report, greater{}, [](auto& e) {return e.stats.vm_steps;});
+        return report;
     }
 
 
@@ -661,6 +747,66 @@ namespace sqnice {
         sqlite3_set_authorizer(check_handle(), ah_ ? authorizer_impl : nullptr, &ah_);
     }
 
+    int database::trace_impl(unsigned type, void* p, void* stmt, void* x) noexcept {
+        auto prof = static_cast<profiler*>(p);
+        auto s = static_cast<sqlite3_stmt*>(stmt);
+        auto i = ranges::find(prof->starts, s, &decltype(prof->starts)::value_type::first);
+        if (type == SQLITE_TRACE_STMT) {
+            // This is also called for each trigger the statement runs; keep the first time.
+            if (i == prof->starts.end()) {
+                try {
+                    prof->starts.emplace_back(s, chrono::steady_clock::now());
+                } catch (...) { }
+            }
+        } else if (type == SQLITE_TRACE_PROFILE) {
+            chrono::nanoseconds duration(*static_cast<int64_t*>(x));
+            chrono::steady_clock::time_point start;
+            if (i != prof->starts.end()) {
+                start = i->second;
+                *i = prof->starts.back();
+                prof->starts.pop_back();
+            } else {
+                start = chrono::steady_clock::now() - duration;
+            }
+            prof->handler(statement_profile{s, duration, start});
+        }
+        return 0;
+    }
+
+    void database::set_profile_handler(profile_handler h) noexcept {
+        if (h) {
+            if (!ph_)
+                ph_ = make_unique<profiler>();
+            ph_->handler = std::move(h);
+            ph_->starts.clear();
+            sqlite3_trace_v2(check_handle(), SQLITE_TRACE_STMT | SQLITE_TRACE_PROFILE,
+                             trace_impl, ph_.get());
+        } else {
+            if (ph_)
+                sqlite3_trace_v2(check_handle(), 0, nullptr, nullptr);
+            ph_.reset();
+        }
+    }
+
+    database::profile_handler const& database::get_profile_handler() const noexcept {
+        static const profile_handler kNoHandler;
+        return ph_ ? ph_->handler : kNoHandler;
+    }
+
+    string_view statement_profile::sql() const noexcept {
+        const char* sql = sqlite3_sql(stmt);
+        return sql ? string_view(sql) : string_view();
+    }
+
+    string statement_profile::expanded_sql() const {
+        string result;
+        if (char* sql = sqlite3_expanded_sql(stmt)) {
+            result = sql;
+            sqlite3_free(sql);
+        }
+        return result;
+    }
+
     status database::register_function(string_view name, 
                                        int nArgs,
                                        function_flags flags,
@@ -0,0 +1,88 @@
+// sqnice/latency_histogram.cc
+//
+// The MIT License
+//
+// Copyright (c) 2015 Wongoo Lee (iwongu at gmail dot com)
+// Copyright (c) 2024 Jens Alfke (Github: snej)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include "sqnice/latency_histogram.hh"
+#include <algorithm>
+#include <cmath>
+
+namespace sqnice {
+    using namespace std;
+
+
+    // The largest value that falls into bucket `index`; the inverse of `bucket_index`.
+    uint64_t latency_histogram::bucket_max(size_t index) noexcept {
+        if (index < 4)
+            return index;
+        unsigned exp = unsigned(index / 4) + 1;
+        uint64_t lower = (4 + (index % 4)) << (exp - 2);
+        return lower + ((uint64_t(1) << (exp - 2)) - 1);
+    }
+
+
+    latency_histogram::duration latency_histogram::mean() const noexcept {
+        uint64_t n = count();
+        return n ? total() / int64_t(n) : duration(0);
+    }
+
+
+    latency_histogram::duration latency_histogram::percentile(double p) const noexcept {
+        uint64_t n = count();
+        if (n == 0)
+            return duration(0);
+        // The rank of the sample to find, counting from 1:
+        auto rank = uint64_t(ceil(clamp(p, 0.0, 1.0) * double(n)));
+        rank = clamp(rank, uint64_t(1), n);
+        uint64_t seen = 0;
+        for (size_t i = 0; i < kBuckets; ++i) {
+            seen += buckets_[i].load(memory_order_relaxed);
+            if (seen >= rank)
+                return duration(int64_t(min(bucket_max(i), uint64_t(max().count()))));
+        }
+        return max();   // (only if `record` ran concurrently)
+    }
+
+
+    void latency_histogram::reset() noexcept {
+        for (auto& b : buckets_)
+            b.store(0, memory_order_relaxed);
+        count_.store(0, memory_order_relaxed);
+        total_.store(0, memory_order_relaxed);
+        max_.store(0, memory_order_relaxed);
+    }
+
+
+    void latency_histogram::merge(latency_histogram const& other) noexcept {
+        for (size_t i = 0; i < kBuckets; ++i)
+            buckets_[i].fetch_add(other.buckets_[i].load(memory_order_relaxed),
+                                  memory_order_relaxed);
+        count_.fetch_add(other.count(), memory_order_relaxed);
+        total_.fetch_add(uint64_t(other.total().count()), memory_order_relaxed);
+        uint64_t om = uint64_t(other.max().count());
+        uint64_t max = max_.load(memory_order_relaxed);
+        while (om > max && !max_.compare_exchange_weak(max, om, memory_order_relaxed))
+            { }
+    }
+
+}
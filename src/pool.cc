@@ -25,16 +25,289 @@
 
 
 #include "sqnice/pool.hh"
+#include "sqnice/transaction.hh"
 #include <cassert>
+#include <thread>
 
 namespace sqnice {
     using namespace std;
 
 
+    /** A fixed set of threads that run `pool::borrow_then` callbacks. */
+    class pool::executor {
+    public:
+        executor(pool& p, unsigned nthreads)
+        :pool_(p)
+        {
+            for (unsigned i = 0; i < nthreads; ++i)
+                threads_.emplace_back([this] {run();});
+        }
+
+        // Runs any remaining jobs, then stops the threads.
+        ~executor() {
+            {
+                unique_lock lock(mutex_);
+                stop_ = true;
+            }
+            cond_.notify_all();
+            for (auto& t : threads_)
+                t.join();
+        }
+
+        void post(function<void(borrowed_database)> fn, database const* db) {
+            {
+                unique_lock lock(mutex_);
+                jobs_.push_back({std::move(fn), db});
+            }
+            cond_.notify_one();
+        }
+
+    private:
+        struct job {
+            function<void(borrowed_database)>   fn;
+            database const*                     db;
+        };
+
+        void run() {
+            unique_lock lock(mutex_);
+            while (true) {
+                cond_.wait(lock, [&] {return stop_ || !jobs_.empty();});
+                if (jobs_.empty())
+                    return;  // stopping
+                job j = std::move(jobs_.front());
+                jobs_.pop_front();
+                lock.unlock();
+                try {
+                    j.fn(borrowed_database(j.db, pool_));
+                } catch (std::exception const& x) {
+                    checking::log_warning("pool: async job threw an exception: %s", x.what());
+                } catch (...) {
+                    checking::log_warning("pool: async job threw an exception");
+                }
+                lock.lock();
+            }
+        }
+
+        pool&                   pool_;
+        mutex                   mutex_;
+        condition_variable      cond_;
+        deque<job>              jobs_;
+        vector<thread>          threads_;
+        bool                    stop_ = false;
+    };
+
+
+    // A slot holding a read-only database parked by a thread, in thread-affinity mode.
+    // (Each is a cache line, so threads using neighboring slots don't contend.)
+    struct alignas(64) pool::affinity_slot {
+        atomic<const database*> db = nullptr;
+    };
+
+    static constexpr unsigned kAffinitySlots = 64;
+
+    // The index of the current thread's slot, assigned round-robin on first use.
+    static unsigned my_slot_index() {
+        static atomic<unsigned> sNextIndex = 0;
+        static thread_local unsigned const tIndex = sNextIndex++ % kAffinitySlots;
+        return tIndex;
+    }
+
+
+    // A thread blocked in `borrow_writeable`, in one of the `_writers` queues.
+    struct pool::writer_waiter {
+        condition_variable      cond;                   // Signaled when `db` is set
+        database* _Nullable     db = nullptr;           // The writeable db, handed to me
+    };
+
+
+    // A function passed to `group_commit` or `async_write`, waiting to be run and committed.
+    struct pool::write_job {
+        function<void(database&)>       fn;
+        function<void(exception_ptr)>   finish;         // Async jobs: called when done
+        exception_ptr                   error;          // Exception thrown by `fn` or the commit
+        bool                            done = false;   // Set when committed or failed
+    };
+
+
+    /** The queue of pending `group_commit` and `async_write` jobs. A group of jobs is run by a
+        leader: the writer thread if it's running, otherwise one of the blocked `group_commit`
+        callers. The leader takes every queued job and commits them together, while jobs arriving
+        meanwhile queue up for the next group. */
+    class pool::write_queue {
+    public:
+        // Runs any remaining jobs, then stops the writer thread.
+        ~write_queue() {
+            stop_writer(nullptr);
+        }
+
+        // Adds a job and blocks until it's been committed or has failed.
+        void run(pool& p, write_job& job) {
+            unique_lock lock(mutex_);
+            push(&job);
+            while (true) {
+                cond_.wait(lock, [&] {return job.done || (!leader_ && !writer_.joinable());});
+                if (job.done)
+                    return;
+                lead(p, lock);      // There's no leader, so I'm it
+            }
+        }
+
+        // Adds a job for the writer thread to run, starting the thread if necessary.
+        // The queue takes ownership of the job and deletes it after calling `finish`.
+        void post(pool& p, unique_ptr<write_job> job) {
+            unique_lock lock(mutex_);
+            _start_writer(p);
+            push(job.release());
+        }
+
+        void start_writer(pool& p) {
+            unique_lock lock(mutex_);
+            _start_writer(p);
+        }
+
+        // Lets the writer thread finish the queued jobs, then stops it, so it returns the
+        // writeable database. If jobs are posted meanwhile, a new writer thread is started for
+        // them, unless `p` is null.
+        void stop_writer(pool* _Nullable p) {
+            {
+                unique_lock lock(mutex_);
+                if (!writer_.joinable())
+                    return;
+                stop_ = true;
+            }
+            writer_cond_.notify_one();
+            writer_.join();
+            unique_lock lock(mutex_);
+            writer_ = thread();
+            stop_ = false;
+            if (p && !jobs_.empty())
+                _start_writer(*p);
+            cond_.notify_all();     // a blocked `run` may have to lead now
+        }
+
+    private:
+        void _start_writer(pool& p) {
+            if (!writer_.joinable())
+                writer_ = thread([this, &p] {run_writer(p);});
+        }
+
+        void push(write_job* job) {
+            jobs_.push_back(job);
+            if (writer_.joinable())
+                writer_cond_.notify_one();
+        }
+
+        // Commits all queued jobs as a group. The mutex is unlocked meanwhile. The writer thread
+        // passes `held`, and keeps the writeable database in it from one group to the next;
+        // otherwise it's borrowed for just this group.
+        using held_database = optional<borrowed_writeable_database>;
+        void lead(pool& p, unique_lock<mutex>& lock, held_database* _Nullable held = nullptr) {
+            leader_ = true;
+            vector<write_job*> group(jobs_.begin(), jobs_.end());
+            jobs_.clear();
+            lock.unlock();
+            try {
+                if (!held) {
+                    p._commit_group(group, *p.borrow_writeable());
+                } else {
+                    if (!*held)
+                        held->emplace(p.borrow_writeable());
+                    p._commit_group(group, *held->value());
+                }
+            } catch (...) {
+                for (write_job* job : group)                // couldn't borrow the database
+                    job->error = current_exception();
+            }
+            for (write_job*& job : group) {
+                if (job->finish) {
+                    job->finish(job->error);
+                    delete job;
+                    job = nullptr;
+                }
+            }
+            lock.lock();
+            for (write_job* job : group) {
+                if (job)
+                    job->done = true;
+            }
+            leader_ = false;
+            cond_.notify_all();
+            writer_cond_.notify_one();
+        }
+
+        // The writer thread's main loop.
+        void run_writer(pool& p) {
+            held_database db;
+            unique_lock lock(mutex_);
+            while (true) {
+                writer_cond_.wait(lock, [&] {return !leader_ && (stop_ || !jobs_.empty());});
+                if (jobs_.empty())
+                    break;  // stopping
+                lead(p, lock, &db);
+            }
+            lock.unlock();
+            db.reset();     // return the database to the pool outside `mutex_`
+        }
+
+        mutex                   mutex_;
+        condition_variable      cond_;              // Wakes `group_commit` callers
+        condition_variable      writer_cond_;       // Wakes the writer thread
+        deque<write_job*>       jobs_;
+        thread                  writer_;            // The writer thread, if started
+        bool                    leader_ = false;    // True while a thread is committing a group
+        bool                    stop_ = false;      // Tells the writer thread to stop
+    };
+
+
+    // Statistics collected while `_collect_stats` is set. Everything is atomic, since it's
+    // updated both with and without the pool's mutex locked.
+    struct pool::stats_state {
+        struct borrows {
+            latency_histogram   wait, hold;
+            atomic<uint64_t>    unavailable = 0, failed = 0;
+            atomic<unsigned>    borrowed = 0, waiting = 0;      // current numbers
+            atomic<unsigned>    peak_borrowed = 0, peak_waiting = 0;
+
+            void start_waiting() noexcept   {raise_peak(peak_waiting, ++waiting);}
+            void stop_waiting() noexcept    {--waiting;}
+
+            void reset() noexcept {
+                wait.reset();
+                hold.reset();
+                unavailable = 0;
+                failed = 0;
+                peak_borrowed = borrowed.load();
+                peak_waiting = waiting.load();
+            }
+
+            void copy_to(pool_stats::borrows& b) const {
+                b.wait = wait;
+                b.hold = hold;
+                b.unavailable = unavailable;
+                b.failed = failed;
+                b.peak_borrowed = peak_borrowed;
+                b.peak_waiting = peak_waiting;
+            }
+        };
+
+        borrows             readonly, writeable;
+        atomic<unsigned>    peak_borrowed = 0;
+
+        borrows& operator[] (bool w) noexcept  {return w ? writeable : readonly;}
+
+        static void raise_peak(atomic<unsigned>& peak, unsigned n) noexcept {
+            unsigned cur = peak.load(memory_order_relaxed);
+            while (n > cur && !peak.compare_exchange_weak(cur, n, memory_order_relaxed))
+                { }
+        }
+    };
+
+
     pool::pool(std::string_view dbname, open_flags flags, const char* vfs)
     :_dbname(dbname)
     ,_vfs(vfs ? vfs : "")
     ,_flags(normalize(flags))
+    ,_write_queue(make_unique<write_queue>())
     {
         if (!!(_flags & open_flags::temporary))
             throw invalid_argument("pool does not support in-memory or temporary databases");
@@ -42,6 +315,13 @@ namespace sqnice {
 
 
     pool::~pool()  {
+        {
+            // Let pending async borrowers finish first:
+            unique_lock lock(_mutex);
+            _cond.wait(lock, [&] {return _async_waiters.empty();});
+        }
+        _executor.reset();
+        _write_queue.reset();   // finishes queued writes
         close_all();
     }
 
@@ -59,9 +339,84 @@ namespace sqnice {
         // internally I don't include writeable db in capacity:
         _ro_capacity = newCapacity - 1;
         // Toss out any excess RO databases:
+        _unpark_all();
         int keep = std::max(0, int(_ro_capacity) - int(_ro_total - _readonly.size()));
-        while (_readonly.size() > keep)
+        while (_readonly.size() > keep) {
             _readonly.pop_back();
+            --_ro_total;
+        }
+        _update_over_capacity();
+        _ro_cond.notify_all();      // in case capacity grew
+    }
+
+
+    void pool::set_thread_affinity(bool affinity) {
+        unique_lock lock(_mutex);
+        if (affinity && !_slots)
+            _slots = make_unique<affinity_slot[]>(kAffinitySlots);
+        _affinity.store(affinity, memory_order_release);
+        if (!affinity) {
+            _unpark_all();
+            _ro_cond.notify_all();
+        }
+    }
+
+
+    void pool::set_collect_stats(bool collect) {
+        unique_lock lock(_mutex);
+        if (collect && !_stats)
+            _stats = make_unique<stats_state>();
+        _collect_stats.store(collect, memory_order_release);
+    }
+
+
+    pool_stats pool::stats() const {
+        pool_stats result;
+        unique_lock lock(_mutex);
+        result.capacity = _ro_capacity + 1;
+        result.open_count = _open_count();
+        result.borrowed_count = _borrowed_count();
+        if (_stats) {
+            _stats->readonly.copy_to(result.readonly);
+            _stats->writeable.copy_to(result.writeable);
+            result.peak_borrowed = _stats->peak_borrowed;
+        }
+        return result;
+    }
+
+
+    void pool::reset_stats() {
+        unique_lock lock(_mutex);
+        if (_stats) {
+            _stats->readonly.reset();
+            _stats->writeable.reset();
+            _stats->peak_borrowed = _stats->readonly.borrowed + _stats->writeable.borrowed;
+        }
+    }
+
+
+    // Records that a database was borrowed, after waiting since `start`.
+    void pool::_borrowed(database const& db, bool writeable,
+                         chrono::steady_clock::time_point start)
+    {
+        auto now = chrono::steady_clock::now();
+        auto& s = (*_stats)[writeable];
+        s.wait.record(now - start);
+        db.borrowed_at_ = now;
+        stats_state::raise_peak(s.peak_borrowed, ++s.borrowed);
+        stats_state::raise_peak(_stats->peak_borrowed,
+                                _stats->readonly.borrowed + _stats->writeable.borrowed);
+    }
+
+
+    // Records that a database was returned, if its borrowing was recorded.
+    void pool::_returned(database const& db, bool writeable) noexcept {
+        if (db.borrowed_at_ != chrono::steady_clock::time_point{}) {
+            auto& s = (*_stats)[writeable];
+            s.hold.record(chrono::steady_clock::now() - db.borrowed_at_);
+            db.borrowed_at_ = {};
+            --s.borrowed;
+        }
     }
 
 
@@ -84,14 +439,18 @@ namespace sqnice {
 
 
     unsigned pool::_borrowed_count() const {
-        return unsigned(_ro_total - _readonly.size()) + (_rw_total - !!_readwrite);
+        return unsigned(int(_ro_total - _readonly.size()) - _parked) + (_rw_total - !!_readwrite);
     }
 
 
     void pool::close_all() {
+        if (_write_queue)
+            _write_queue->stop_writer(this);    // it holds the writeable database
         unique_lock lock(_mutex);
         _close_unused();
+        ++_waiting;         // makes returned databases come back through the mutex
         _cond.wait(lock, [&] { return _borrowed_count() == 0; });
+        --_waiting;
         _close_unused();
         assert(_open_count() == 0);
     }
@@ -104,12 +463,45 @@ namespace sqnice {
 
 
     void pool::_close_unused() {
+        _unpark_all();
         _ro_total -= _readonly.size();
         _readonly.clear();
         if (_readwrite) {
             _readwrite = nullptr;
             _rw_total = 0;
         }
+        _update_over_capacity();
+        _ro_cond.notify_all();      // waiters can open new databases now
+    }
+
+
+    // Takes a database parked in any thread's affinity slot, starting with this thread's.
+    const database* pool::_take_parked() {
+        if (!_slots || _parked.load() <= 0)
+            return nullptr;
+        unsigned start = my_slot_index();
+        for (unsigned i = 0; i < kAffinitySlots; ++i) {
+            auto& slot = _slots[(start + i) % kAffinitySlots];
+            if (slot.db.load(memory_order_relaxed)) {
+                if (const database* db = slot.db.exchange(nullptr)) {
+                    --_parked;
+                    return db;
+                }
+            }
+        }
+        return nullptr;
+    }
+
+
+    // Moves all parked databases back to `_readonly`.
+    void pool::_unpark_all() {
+        while (const database* db = _take_parked())
+            _readonly.emplace_back(db);
+    }
+
+
+    void pool::_update_over_capacity() {
+        _over_capacity = (_ro_total > _ro_capacity);
     }
 
 
@@ -119,7 +511,14 @@ namespace sqnice {
         auto flags = _flags;
         if (!writeable)
             flags = flags - readwrite - create;
-        auto db = make_unique<database>(_dbname, flags, (_vfs.empty() ? nullptr : _vfs.c_str()));
+        unique_ptr<database> db;
+        try {
+            db = make_unique<database>(_dbname, flags, (_vfs.empty() ? nullptr : _vfs.c_str()));
+        } catch (...) {
+            if (_collect_stats.load(memory_order_relaxed))
+                ++(*_stats)[writeable].failed;
+            throw;
+        }
         _flags = _flags - delete_first; // definitely don't want to do that twice!
         if (_initializer)
             _initializer(*db);
@@ -127,68 +526,247 @@ namespace sqnice {
     }
 
 
+    // Returns an available read-only database, opening one if necessary, or else nullptr.
+    unique_ptr<const database> pool::_take_readonly() {
+        unique_ptr<const database> dbp;
+        if (!_readonly.empty()) {
+            dbp = std::move(_readonly.back());
+            _readonly.pop_back();
+        } else if (_ro_total < _ro_capacity) {
+            dbp = new_db(false);
+            ++_ro_total;
+        }
+        return dbp;
+    }
+
+
     borrowed_database pool::borrow(bool or_wait) {
+        bool const collect = _collect_stats.load(memory_order_acquire);
+        chrono::steady_clock::time_point start;
+        if (collect)
+            start = chrono::steady_clock::now();
+
+        if (_affinity.load(memory_order_acquire)) {
+            // Fast path: take back the database this thread parked, without locking:
+            auto& slot = _slots[my_slot_index()];
+            if (slot.db.load(memory_order_relaxed)) {
+                if (const database* db = slot.db.exchange(nullptr)) {
+                    --_parked;
+                    db->set_borrowed(true);
+                    if (collect)
+                        _borrowed(*db, false, start);
+                    return borrowed_database(db, *this);
+                }
+            }
+        }
+
         unique_lock lock(_mutex);
+        bool waiting = false, blocked = false;
         while(true) {
-            unique_ptr<const database> dbp;
-            if (!_readonly.empty()) {
-                dbp = std::move(_readonly.back());
-                _readonly.pop_back();
-            } else if (_ro_total < _ro_capacity) {
-                dbp = new_db(false);
-                ++_ro_total;
-            }
-            if (dbp) {
+            unique_ptr<const database> dbp = _take_readonly();
+            if (!dbp) {
+                // Count myself as waiting *before* checking the slots, so that a thread parking
+                // a database after I've looked will see me and return it the slow way instead:
+                if (!waiting) {
+                    ++_waiting;
+                    waiting = true;
+                }
+                dbp.reset(_take_parked());
+            }
+            if (dbp || !or_wait) {
+                if (waiting)
+                    --_waiting;
+                if (blocked)
+                    _stats->readonly.stop_waiting();
+                if (!dbp) {
+                    if (collect)
+                        ++_stats->readonly.unavailable;
+                    return {nullptr, *this};
+                }
                 dbp->set_borrowed(true);
+                if (collect)
+                    _borrowed(*dbp, false, start);
                 return borrowed_database(dbp.release(), *this);
-            } else if (!or_wait) {
-                return {nullptr, *this};
             }
             // Nothing available, so wait
-            _cond.wait(lock);
+            if (collect && !blocked) {
+                _stats->readonly.start_waiting();
+                blocked = true;
+            }
+            _ro_cond.wait(lock);
         }
     }
 
 
-    borrowed_writeable_database pool::borrow_writeable(bool or_wait) {
+    void pool::borrow_then(function<void(borrowed_database)> fn) {
+        unique_lock lock(_mutex);
+        if (!_executor)
+            _executor = make_unique<executor>(*this, _ro_capacity);
+        unique_ptr<const database> dbp = _take_readonly();
+        if (!dbp) {
+            ++_waiting;     // (see `borrow`)
+            dbp.reset(_take_parked());
+            if (dbp)
+                --_waiting;
+        }
+        if (_collect_stats.load(memory_order_acquire)) {
+            // Wrap `fn` to record the time it waited, including in the executor's queue:
+            bool queued = !dbp;
+            if (queued)
+                _stats->readonly.start_waiting();
+            fn = [this, fn = std::move(fn), queued, start = chrono::steady_clock::now()]
+                 (borrowed_database db) {
+                if (queued)
+                    _stats->readonly.stop_waiting();
+                _borrowed(*db, false, start);
+                fn(std::move(db));
+            };
+        }
+        if (dbp) {
+            dbp->set_borrowed(true);
+            _executor->post(std::move(fn), dbp.release());
+        } else {
+            _async_waiters.push_back(std::move(fn));    // remains counted in `_waiting`
+        }
+    }
+
+
+    borrowed_writeable_database pool::_borrow_writeable(bool or_wait, write_priority priority) {
         if (!(_flags & (open_flags::readwrite | open_flags::delete_first)))
             throw logic_error("no writeable database available");
+        bool const collect = _collect_stats.load(memory_order_acquire);
+        chrono::steady_clock::time_point start;
+        if (collect)
+            start = chrono::steady_clock::now();
         unique_lock lock(_mutex);
         unique_ptr<database> dbp;
         if (_rw_total == 0) {
             // First-time creation of the writeable db:
             dbp = new_db(true);
             if (!dbp->is_writeable()) {
+                if (collect)
+                    ++_stats->writeable.failed;
                 throw database_error("database file is not writeable", status::locked);
             }
             ++_rw_total;
-        } else if (_readwrite || or_wait) {
-            // Get the db, waiting if necessary:
-            _cond.wait(lock, [&] {return _readwrite != nullptr;});
+        } else if (_readwrite) {
             dbp = std::move(_readwrite);
+        } else if (or_wait) {
+            // Get in line, and wait until the returning thread hands me the db:
+            writer_waiter w;
+            _writers[size_t(priority)].push_back(&w);
+            if (collect)
+                _stats->writeable.start_waiting();
+            w.cond.wait(lock, [&] {return w.db != nullptr;});
+            if (collect)
+                _stats->writeable.stop_waiting();
+            dbp.reset(w.db);
         } else {
             // db isn't available and `or_wait` is false, so return null:
+            if (collect)
+                ++_stats->writeable.unavailable;
             return borrowed_writeable_database{nullptr, *this};
         }
         dbp->set_borrowed(true);
+        if (collect)
+            _borrowed(*dbp, true, start);
         return borrowed_writeable_database(dbp.release(), *this);
     }
 
 
+    void pool::_group_commit(function<void(database&)> fn) {
+        write_job job {std::move(fn), nullptr};
+        _write_queue->run(*this, job);
+        if (job.error)
+            rethrow_exception(job.error);
+    }
+
+
+    void pool::_async_write(function<void(database&)> fn, function<void(exception_ptr)> finish) {
+        auto job = make_unique<write_job>(write_job{std::move(fn), std::move(finish)});
+        _write_queue->post(*this, std::move(job));
+    }
+
+
+    void pool::start_writer_thread() {
+        _write_queue->start_writer(*this);
+    }
+
+    void pool::stop_writer_thread() {
+        _write_queue->stop_writer(this);
+    }
+
+
+    // Runs a group of jobs in one transaction, each in a nested one (a savepoint), and commits.
+    void pool::_commit_group(vector<write_job*> const& group, database& db) noexcept {
+        try {
+            transaction txn(db);
+            for (write_job* job : group) {
+                try {
+                    transaction savepoint(db);
+                    job->fn(db);
+                    if (status rc = savepoint.commit(); !ok(rc))
+                        db.raise(rc);
+                } catch (...) {
+                    job->error = current_exception();   // `savepoint` has rolled back
+                }
+            }
+            if (status rc = txn.commit(); !ok(rc))
+                db.raise(rc);
+        } catch (...) {
+            for (write_job* job : group) {
+                if (!job->error)
+                    job->error = current_exception();
+            }
+        }
+    }
+
+
     // The "deleter" function of `borrowed_ro_db`. Returns the db to the pool.
     void pool::operator()(database const* dbp) noexcept {
         if (dbp) {
             const_cast<database*>(dbp)->set_borrowed(false);
-            unique_lock lock(_mutex);
             assert(!dbp->is_writeable());
+            _returned(*dbp, false);
+            if (_affinity.load(memory_order_acquire) && !_over_capacity.load()) {
+                // Fast path: park the database in this thread's slot, without locking:
+                auto& slot = _slots[my_slot_index()];
+                // (`_parked` is only incremented once the database is in the slot; until then
+                // `_borrowed_count` still counts it, so `close_all` can't finish without it.)
+                const database* expected = nullptr;
+                if (slot.db.compare_exchange_strong(expected, dbp)) {
+                    ++_parked;
+                    if (_waiting.load() == 0)
+                        return;
+                    // Someone's waiting, so unless they already took it, un-park the database
+                    // and return it the normal way, which wakes them:
+                    expected = dbp;
+                    if (!slot.db.compare_exchange_strong(expected, nullptr))
+                        return;
+                    --_parked;
+                }
+            }
+
+            unique_lock lock(_mutex);
             assert(_readonly.size() < _ro_total);
             if (_ro_total <= _ro_capacity) {
-                _readonly.emplace_back(dbp);
+                if (!_async_waiters.empty()) {
+                    // Hand the database directly to the oldest async waiter:
+                    const_cast<database*>(dbp)->set_borrowed(true);
+                    _executor->post(std::move(_async_waiters.front()), dbp);
+                    _async_waiters.pop_front();
+                    --_waiting;
+                } else {
+                    _readonly.emplace_back(dbp);
+                    _ro_cond.notify_one();
+                }
                 _cond.notify_all();
             } else {
                 // Toss out a DB if capacity was lowered after it was checked out:
                 delete dbp;
                 --_ro_total;
+                _update_over_capacity();
+                _cond.notify_all();
             }
         }
     }
@@ -199,11 +777,22 @@ namespace sqnice {
         if (dbp) {
             dbp->set_borrowed(false);
             assert(dbp->is_writeable());
+            _returned(*dbp, true);
             assert(dbp->transaction_depth() == 0);
             unique_lock lock(_mutex);
             assert(_rw_total == 1);
             assert(!_readwrite);
-            _readwrite.reset(const_cast<database*>(dbp));
+            for (auto& queue : _writers) {
+                if (!queue.empty()) {
+                    // Hand the database directly to the first waiter of the highest priority:
+                    writer_waiter* w = queue.front();
+                    queue.pop_front();
+                    w->db = dbp;
+                    w->cond.notify_one();
+                    return;
+                }
+            }
+            _readwrite.reset(dbp);
             _cond.notify_all();
         }
     }
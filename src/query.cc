@@ -25,11 +25,15 @@
 
 
 #include "sqnice/query.hh"
+#include "sqnice/column_batch.hh"
 #include "sqnice/database.hh"
 #include "sqnice/functions.hh"
+#include "bind_capture.hh"
 #include "statement_cache.hh"
+#include <atomic>
 #include <cassert>
 #include <memory>
+#include <unordered_map>
 
 #ifdef SQNICE_LOADABLE_EXTENSION
 #  include <sqlite3ext.h>
@@ -51,14 +55,67 @@ namespace sqnice {
     null_type ignore;
 
 
+#pragma mark - PARAMETER NAMES:
+
+
+    parameter_names::parameter_names(initializer_list<const char*> names)
+    :names_(names.begin(), names.end())
+    {
+        static atomic<unsigned> sLastID = 0;
+        id_ = ++sLastID;
+    }
+
+
 #pragma mark - STATEMENT:
 
 
     statement::impl::~impl()    {
+        if (bind_capture::active()) [[unlikely]]
+            bind_capture::finalized(stmt);
         sqlite3_finalize(stmt);
     }
 
 
+    // If a `workload_recorder` exists and `rc` is OK, tells it the value bound to parameter
+    // `idx`, as returned by `fn`. Returns `rc`.
+    template <typename Fn>
+    static int captured(sqlite3_stmt* stmt, int rc, int idx, Fn fn) noexcept {
+        if (bind_capture::active() && rc == SQLITE_OK) [[unlikely]] {
+            try {
+                bind_capture::bound(stmt, idx, fn());
+            } catch (...) {
+                bind_capture::bound_unrecordable(stmt, idx);
+            }
+        }
+        return rc;
+    }
+
+    static workload_value capture_blob(blob value) {
+        if (!value.data)
+            return vector<byte>(value.size);    // zeroblob
+        auto bytes = static_cast<const byte*>(value.data);
+        return vector<byte>(bytes, bytes + value.size);
+    }
+
+    static workload_value capture_value(sqlite3_value* value) {
+        switch (sqlite3_value_type(value)) {
+            case SQLITE_INTEGER:
+                return int64_t(sqlite3_value_int64(value));
+            case SQLITE_FLOAT:
+                return sqlite3_value_double(value);
+            case SQLITE_TEXT: {
+                auto text = reinterpret_cast<const char*>(sqlite3_value_text(value));
+                return string(text, size_t(sqlite3_value_bytes(value)));
+            }
+            case SQLITE_BLOB:
+                return capture_blob(blob{sqlite3_value_blob(value),
+                                         size_t(sqlite3_value_bytes(value))});
+            default:
+                return nullptr;
+        }
+    }
+
+
     statement::statement(checking const& ck, shared_ptr<impl> impl) noexcept
     :checking(ck),
     impl_(std::move(impl))
@@ -133,6 +190,8 @@ namespace sqnice {
         } else if (ok(rc)) {
             finish();
             impl_ = make_shared<impl>(stmt);
+            if (bind_capture::active()) [[unlikely]]
+                bind_capture::prepared(stmt);
         }
         return check(rc);
     }
@@ -153,6 +212,24 @@ namespace sqnice {
                                           name, sqlite3_sql(any_stmt())));
     }
 
+    span<const int> statement::parameter_indexes(parameter_names const& names) {
+        (void)any_stmt();   // throws if not prepared
+        auto& resolved = impl_->resolved_names_;
+        for (auto& [id, indexes] : resolved) {
+            if (id == names.id()) [[likely]]
+                return indexes;
+        }
+        vector<int> indexes;
+        indexes.reserve(names.size());
+        for (string const& name : names.names()) {
+            int idx = parameter_index(name.c_str());
+            if (idx == 0 && exceptions_) [[unlikely]]
+                (void)check_parameter_index(name.c_str());    // throws
+            indexes.push_back(idx);
+        }
+        return resolved.emplace_back(names.id(), std::move(indexes)).second;
+    }
+
     void statement::finish() noexcept {
         if (impl_) {
             if (impl_->transfer_owner(this, nullptr))
@@ -206,6 +283,87 @@ namespace sqnice {
         return result;
     }
 
+    size_t statement::memory_used() const noexcept {
+        return impl_ ? sqlite3_stmt_status(impl_->stmt, SQLITE_STMTSTATUS_MEMUSED, 0) : 0;
+    }
+
+    query_plan statement::plan() const {
+        return query_plan(*this, sql());
+    }
+
+#ifdef SQNICE_ENABLE_SCANSTATUS
+    vector<loop_stats> statement::scan_stats() const {
+        vector<loop_stats> result;
+        if (!impl_)
+            return result;
+        sqlite3_stmt* stmt = impl_->stmt;
+        constexpr int kFlags = SQLITE_SCANSTAT_COMPLEX;
+        for (int i = 0; ; ++i) {
+            int id;
+            if (sqlite3_stmt_scanstatus_v2(stmt, i, SQLITE_SCANSTAT_SELECTID, kFlags, &id) != 0)
+                break;      // no more elements
+            loop_stats& s = result.emplace_back();
+            s.node.id = id;
+            sqlite3_stmt_scanstatus_v2(stmt, i, SQLITE_SCANSTAT_PARENTID, kFlags, &s.node.parent);
+            const char* str = nullptr;
+            sqlite3_stmt_scanstatus_v2(stmt, i, SQLITE_SCANSTAT_EXPLAIN, kFlags, &str);
+            if (str)
+                s.node.detail = str;
+            str = nullptr;
+            sqlite3_stmt_scanstatus_v2(stmt, i, SQLITE_SCANSTAT_NAME, kFlags, &str);
+            if (str)
+                s.name = str;
+            sqlite3_int64 n;
+            if (sqlite3_stmt_scanstatus_v2(stmt, i, SQLITE_SCANSTAT_NLOOP, kFlags, &n) == 0)
+                s.loops = n;
+            if (sqlite3_stmt_scanstatus_v2(stmt, i, SQLITE_SCANSTAT_NVISIT, kFlags, &n) == 0)
+                s.rows_visited = n;
+            if (sqlite3_stmt_scanstatus_v2(stmt, i, SQLITE_SCANSTAT_NCYCLE, kFlags, &n) == 0)
+                s.cycles = n;
+            double est;
+            if (sqlite3_stmt_scanstatus_v2(stmt, i, SQLITE_SCANSTAT_EST, kFlags, &est) == 0)
+                s.estimated_rows = est;
+        }
+        return result;
+    }
+
+    void statement::reset_scan_stats() noexcept {
+        if (impl_)
+            sqlite3_stmt_scanstatus_reset(impl_->stmt);
+    }
+#endif
+
+    statement_stats statement::stats(bool reset) const noexcept {
+        statement_stats s;
+        if (impl_) {
+            auto get = [&](int op) {return uint64_t(sqlite3_stmt_status(impl_->stmt, op, reset));};
+            s.fullscan_steps = get(SQLITE_STMTSTATUS_FULLSCAN_STEP);
+            s.sorts          = get(SQLITE_STMTSTATUS_SORT);
+            s.autoindexes    = get(SQLITE_STMTSTATUS_AUTOINDEX);
+            s.vm_steps       = get(SQLITE_STMTSTATUS_VM_STEP);
+            s.reprepares     = get(SQLITE_STMTSTATUS_REPREPARE);
+            s.runs           = get(SQLITE_STMTSTATUS_RUN);
+            s.filter_hits    = get(SQLITE_STMTSTATUS_FILTER_HIT);
+            s.filter_misses  = get(SQLITE_STMTSTATUS_FILTER_MISS);
+            s.memory_used    = size_t(sqlite3_stmt_status(impl_->stmt,
+                                                          SQLITE_STMTSTATUS_MEMUSED, 0));
+        }
+        return s;
+    }
+
+    statement_stats& statement_stats::operator+= (statement_stats const& s) noexcept {
+        fullscan_steps += s.fullscan_steps;
+        sorts += s.sorts;
+        autoindexes += s.autoindexes;
+        vm_steps += s.vm_steps;
+        reprepares += s.reprepares;
+        runs += s.runs;
+        filter_hits += s.filter_hits;
+        filter_misses += s.filter_misses;
+        memory_used += s.memory_used;
+        return *this;
+    }
+
     bool statement::busy() const noexcept {
         return impl_ && sqlite3_stmt_busy(impl_->stmt);
     }
@@ -218,8 +376,11 @@ namespace sqnice {
     }
 
     void statement::clear_bindings() {
-        if (impl_) [[likely]]
+        if (impl_) [[likely]] {
             sqlite3_clear_bindings(stmt());
+            if (bind_capture::active()) [[unlikely]]
+                bind_capture::cleared(stmt());
+        }
     }
 
     status statement::check_bind(int rc, int idx) {
@@ -231,15 +392,18 @@ namespace sqnice {
     }
 
     status statement::bind_int(int idx, int value) {
-        return check_bind(sqlite3_bind_int(stmt(), idx, value), idx);
+        int rc = sqlite3_bind_int(stmt(), idx, value);
+        return check_bind(captured(stmt(), rc, idx, [&] {return int64_t(value);}), idx);
     }
 
     status statement::bind_double(int idx, double value) {
-        return check_bind(sqlite3_bind_double(stmt(), idx, value), idx);
+        int rc = sqlite3_bind_double(stmt(), idx, value);
+        return check_bind(captured(stmt(), rc, idx, [&] {return value;}), idx);
     }
 
     status statement::bind_int64(int idx, int64_t value) {
-        return check_bind(sqlite3_bind_int64(stmt(), idx, value), idx);
+        int rc = sqlite3_bind_int64(stmt(), idx, value);
+        return check_bind(captured(stmt(), rc, idx, [&] {return value;}), idx);
     }
 
     status statement::bind_uint64(int idx, uint64_t value) {
@@ -250,13 +414,15 @@ namespace sqnice {
     }
 
     status statement::bind(int idx, string_view value) {
-        return check_bind(sqlite3_bind_text64(stmt(), idx, value.data(), value.size(),
-                                              SQLITE_TRANSIENT, SQLITE_UTF8), idx);
+        int rc = sqlite3_bind_text64(stmt(), idx, value.data(), value.size(),
+                                     SQLITE_TRANSIENT, SQLITE_UTF8);
+        return check_bind(captured(stmt(), rc, idx, [&] {return string(value);}), idx);
     }
 
     status statement::bind(int idx, uncopied_string value) {
-        return check_bind(sqlite3_bind_text64(stmt(), idx, value.data(), value.size(),
-                                              SQLITE_STATIC, SQLITE_UTF8), idx);
+        int rc = sqlite3_bind_text64(stmt(), idx, value.data(), value.size(),
+                                     SQLITE_STATIC, SQLITE_UTF8);
+        return check_bind(captured(stmt(), rc, idx, [&] {return string(value);}), idx);
     }
 
     status statement::bind_blob(int idx, blob value, bool copy) {
@@ -266,19 +432,24 @@ namespace sqnice {
                                      copy ? SQLITE_TRANSIENT : SQLITE_STATIC);
         else
             rc = sqlite3_bind_zeroblob64(stmt(), idx, value.size);
-        return check_bind(rc, idx);
+        return check_bind(captured(stmt(), rc, idx, [&] {return capture_blob(value);}), idx);
     }
 
     status statement::bind_pointer(int idx, void* ptr, const char* type, pointer_destructor dtor) {
-        return check_bind(sqlite3_bind_pointer(stmt(), idx, ptr, type, dtor), idx);
+        int rc = sqlite3_bind_pointer(stmt(), idx, ptr, type, dtor);
+        if (bind_capture::active() && rc == SQLITE_OK) [[unlikely]]
+            bind_capture::bound_unrecordable(stmt(), idx);
+        return check_bind(rc, idx);
     }
 
     status statement::bind(int idx, nullptr_t) {
-        return check_bind(sqlite3_bind_null(stmt(), idx), idx);
+        int rc = sqlite3_bind_null(stmt(), idx);
+        return check_bind(captured(stmt(), rc, idx, [] {return nullptr;}), idx);
     }
 
     status statement::bind(int idx, arg_value v) {
-        return check_bind(sqlite3_bind_value(stmt(), idx, v.value()), idx);
+        int rc = sqlite3_bind_value(stmt(), idx, v.value());
+        return check_bind(captured(stmt(), rc, idx, [&] {return capture_value(v.value());}), idx);
     }
 
     statement::bindref statement::operator[] (char const *name) {
@@ -293,6 +464,149 @@ namespace sqnice {
     }
 
 
+#pragma mark - FAST HANDLE:
+
+
+    statement::fast_handle statement::fast() {
+        return fast_handle(*this);
+    }
+
+    statement::fast_handle::fast_handle(statement& s)
+    :db_(s.check_get_db())
+    ,impl_(s.give_impl(this))   // throws if unprepared or in use
+    ,stmt_(impl_->stmt)
+    { }
+
+    statement::fast_handle::fast_handle(fast_handle&& other) noexcept
+    :db_(std::move(other.db_))
+    ,impl_(std::move(other.impl_))
+    ,stmt_(other.stmt_)
+    {
+        if (impl_)
+            impl_->transfer_owner(&other, this);
+    }
+
+    statement::fast_handle::~fast_handle() {
+        if (impl_ && impl_->transfer_owner(this, nullptr)) {
+            sqlite3_reset(stmt_);
+            sqlite3_clear_bindings(stmt_);  // uncopied strings/blobs are about to go out of scope
+            if (bind_capture::active()) [[unlikely]]
+                bind_capture::cleared(stmt_);
+        }
+    }
+
+#define ASSERT_VALID() assert(impl_ && impl_->owned_by(this))
+
+    status statement::fast_handle::bind_int(int idx, int v) noexcept {
+        ASSERT_VALID();
+        return status{captured(stmt_, sqlite3_bind_int(stmt_, idx, v), idx,
+                               [&] {return int64_t(v);})};
+    }
+
+    status statement::fast_handle::bind_int64(int idx, int64_t v) noexcept {
+        ASSERT_VALID();
+        return status{captured(stmt_, sqlite3_bind_int64(stmt_, idx, v), idx, [&] {return v;})};
+    }
+
+    status statement::fast_handle::bind_double(int idx, double v) noexcept {
+        ASSERT_VALID();
+        return status{captured(stmt_, sqlite3_bind_double(stmt_, idx, v), idx, [&] {return v;})};
+    }
+
+    status statement::fast_handle::bind(int idx, string_view v) noexcept {
+        ASSERT_VALID();
+        int rc = sqlite3_bind_text64(stmt_, idx, v.data(), v.size(), SQLITE_STATIC, SQLITE_UTF8);
+        return status{captured(stmt_, rc, idx, [&] {return string(v);})};
+    }
+
+    status statement::fast_handle::bind(int idx, blob v) noexcept {
+        ASSERT_VALID();
+        int rc;
+        if (v.data)
+            rc = sqlite3_bind_blob64(stmt_, idx, v.data, v.size, SQLITE_STATIC);
+        else
+            rc = sqlite3_bind_zeroblob64(stmt_, idx, v.size);
+        return status{captured(stmt_, rc, idx, [&] {return capture_blob(v);})};
+    }
+
+    status statement::fast_handle::bind(int idx, nullptr_t) noexcept {
+        ASSERT_VALID();
+        return status{captured(stmt_, sqlite3_bind_null(stmt_, idx), idx, [] {return nullptr;})};
+    }
+
+    void statement::fast_handle::clear_bindings() noexcept {
+        ASSERT_VALID();
+        sqlite3_clear_bindings(stmt_);
+        if (bind_capture::active()) [[unlikely]]
+            bind_capture::cleared(stmt_);
+    }
+
+    status statement::fast_handle::step() noexcept {
+        ASSERT_VALID();
+        return status{sqlite3_step(stmt_)};
+    }
+
+    status statement::fast_handle::execute() noexcept {
+        ASSERT_VALID();
+        auto rc = status{sqlite3_step(stmt_)};
+        sqlite3_reset(stmt_);
+        return (rc == status::done) ? status::ok : rc;
+    }
+
+    void statement::fast_handle::reset() noexcept {
+        ASSERT_VALID();
+        sqlite3_reset(stmt_);
+    }
+
+    int64_t statement::fast_handle::last_insert_rowid() const noexcept {
+        return sqlite3_last_insert_rowid(db_.get());
+    }
+
+    int statement::fast_handle::changes() const noexcept {
+        return sqlite3_changes(db_.get());
+    }
+
+    int statement::fast_handle::column_count() const noexcept {
+        return sqlite3_data_count(stmt_);
+    }
+
+    data_type statement::fast_handle::column_type(int idx) const noexcept {
+        assert(idx >= 0 && idx < sqlite3_data_count(stmt_));
+        return data_type{sqlite3_column_type(stmt_, idx)};
+    }
+
+    int statement::fast_handle::column_int(int idx) const noexcept {
+        assert(idx >= 0 && idx < sqlite3_data_count(stmt_));
+        return sqlite3_column_int(stmt_, idx);
+    }
+
+    int64_t statement::fast_handle::column_int64(int idx) const noexcept {
+        assert(idx >= 0 && idx < sqlite3_data_count(stmt_));
+        return sqlite3_column_int64(stmt_, idx);
+    }
+
+    double statement::fast_handle::column_double(int idx) const noexcept {
+        assert(idx >= 0 && idx < sqlite3_data_count(stmt_));
+        return sqlite3_column_double(stmt_, idx);
+    }
+
+    string_view statement::fast_handle::column_text(int idx) const noexcept {
+        assert(idx >= 0 && idx < sqlite3_data_count(stmt_));
+        auto text = reinterpret_cast<const char*>(sqlite3_column_text(stmt_, idx));
+        if (!text)
+            return {};
+        return {text, size_t(sqlite3_column_bytes(stmt_, idx))};
+    }
+
+    span<const byte> statement::fast_handle::column_blob(int idx) const noexcept {
+        assert(idx >= 0 && idx < sqlite3_data_count(stmt_));
+        auto data = sqlite3_column_blob(stmt_, idx);
+        return {(const byte*)data, size_t(sqlite3_column_bytes(stmt_, idx))};
+    }
+
+#undef ASSERT_VALID
+
+
 #pragma mark - COMMAND:
 
 
@@ -319,6 +633,91 @@ namespace sqnice {
     }
 
 
+    // `execute_many` support. A command doesn't know its `database` object, so it can't call
+    // `database::begin_transaction`; instead it follows the same policy directly on the
+    // connection: `BEGIN IMMEDIATE` at top level, or a savepoint inside an open transaction.
+    // (Nothing else can run on the connection until `end_batch`, so this doesn't disturb
+    // the database's own transaction bookkeeping.)
+
+    static constexpr const char* kBeginBatchSavepoint = "SAVEPOINT sqnice_batch";
+    static constexpr const char* kReleaseBatchSavepoint = "RELEASE SAVEPOINT sqnice_batch";
+    static constexpr const char* kRollbackBatchSavepoint =
+        "ROLLBACK TO SAVEPOINT sqnice_batch; RELEASE SAVEPOINT sqnice_batch";
+
+    status command::begin_batch() {
+        auto db = check_get_db();
+        (void)stmt();   // claim ownership, or throw if it's busy
+        batch_txn_ = sqlite3_get_autocommit(db.get());
+        const char* sql = batch_txn_ ? "BEGIN IMMEDIATE" : kBeginBatchSavepoint;
+        if (auto rc = status{sqlite3_exec(db.get(), sql, nullptr, nullptr, nullptr)};
+                !ok(rc)) [[unlikely]] {
+            reset();
+            return check(rc);
+        }
+        last_rowid_ = -1;
+        changes_ = 0;
+        return status::ok;
+    }
+
+    status command::step_batch(vector<int64_t>* rowids) noexcept {
+        sqlite3_stmt* stmtPointer = any_stmt();     // (begin_batch already took ownership)
+        auto rc = status{sqlite3_step(stmtPointer)};
+        sqlite3* db = sqlite3_db_handle(stmtPointer);
+        if (rc == status::done) [[likely]] {
+            rc = status::ok;
+            changes_ += sqlite3_changes(db);
+            last_rowid_ = sqlite3_last_insert_rowid(db);
+            if (rowids) {
+                try {
+                    rowids->push_back(last_rowid_);
+                } catch (...) {
+                    rc = status{SQLITE_NOMEM};
+                }
+            }
+        }
+        sqlite3_reset(stmtPointer);     // no need to give up ownership in the middle of a batch
+        return rc;
+    }
+
+    status command::end_batch(status rc) {
+        auto db = check_get_db();
+        // Save the error message before rolling back, since that clears it:
+        string msg;
+        if (!ok(rc) && exceptions_)
+            msg = sqlite3_errmsg(db.get());
+        rc = finish_batch(rc);
+        if (!msg.empty())
+            raise(rc, msg.c_str());
+        return check(rc);
+    }
+
+    // Commits or rolls back the batch and cleans up, without throwing. Returns the first error.
+    status command::finish_batch(status rc) noexcept {
+        sqlite3_stmt* stmtPointer = any_stmt();
+        sqlite3* db = sqlite3_db_handle(stmtPointer);
+        sqlite3_clear_bindings(stmtPointer);  // uncopied strings/blobs are about to go out of scope
+        if (bind_capture::active()) [[unlikely]]
+            bind_capture::cleared(stmtPointer);
+        reset();
+        const char* sql;
+        if (ok(rc))
+            sql = batch_txn_ ? "COMMIT" : kReleaseBatchSavepoint;
+        else if (batch_txn_)
+            sql = "ROLLBACK";
+        else
+            sql = kRollbackBatchSavepoint;
+        auto end_rc = status{sqlite3_exec(db, sql, nullptr, nullptr, nullptr)};
+        if (!ok(end_rc) && ok(rc) && batch_txn_)
+            (void)sqlite3_exec(db, "ROLLBACK", nullptr, nullptr, nullptr);
+        if (!ok(rc) || !ok(end_rc)) {
+            last_rowid_ = -1;
+            changes_ = 0;
+            return ok(rc) ? end_rc : rc;
+        }
+        return status::ok;
+    }
+
+
 #pragma mark - QUERY:
 
 
@@ -342,6 +741,11 @@ namespace sqnice {
     }
 
 
+    size_t query::fetch_columns(column_batch& batch, size_t max_rows) {
+        return begin().fetch_columns(batch, max_rows);
+    }
+
+
 #pragma mark - QUERY ROW:
 
 
@@ -452,4 +856,157 @@ namespace sqnice {
         return *this;
     }
 
+    size_t query::iterator::fetch_columns(column_batch& batch, size_t max_rows) {
+        size_t n = 0;
+        if (*this) {
+            // `append_row` reads columns via `sqlite3_column_value` and the faster
+            // `sqlite3_value_*` accessors, instead of `sqlite3_column_*`, each of which locks
+            // and unlocks the mutex. Those values are *unprotected*, so this is only safe
+            // because we hold the connection's mutex meanwhile. (It's recursive, so stepping
+            // still works.)
+            struct lock_guard {
+                explicit lock_guard(sqlite3_mutex* m)   :mutex(m) {sqlite3_mutex_enter(m);}
+                ~lock_guard()                           {sqlite3_mutex_leave(mutex);}
+                sqlite3_mutex* mutex;
+            } lock(sqlite3_db_mutex(sqlite3_db_handle(impl_->stmt)));
+
+            batch.start(sqlite3_column_count(impl_->stmt));
+            for (; n < max_rows && *this; ++n) {
+                batch.append_row(impl_->stmt);
+                ++(*this);
+            }
+        } else {
+            batch.clear();
+        }
+        return n;
+    }
+
+
+
+#pragma mark - QUERY PLAN:
+
+
+    query_plan::query_plan(checking const& db, string_view sql) {
+        query eqp(db, "EXPLAIN QUERY PLAN " + string(sql));
+        for (auto row : eqp)
+            nodes_.push_back({row.get<int>(0), row.get<int>(1), row.get<string>(3)});
+    }
+
+    query_plan::op query_plan::node::kind() const noexcept {
+        string_view d = detail;
+        if (d.starts_with("SCAN "))
+            return op::scan;
+        else if (d.starts_with("SEARCH "))
+            return op::search;
+        else if (d.starts_with("COMPOUND ") || d.starts_with("LEFT-MOST ")
+                 || d.starts_with("UNION ") || d.starts_with("INTERSECT ")
+                 || d.starts_with("EXCEPT ") || d.starts_with("MERGE "))
+            return op::compound;
+        else if (d.starts_with("USE TEMP B-TREE"))
+            return op::temp_btree;
+        else if (d.find("SUBQUERY") != string_view::npos)
+            return op::subquery;
+        else if (d.starts_with("MATERIALIZE ") || d.starts_with("CO-ROUTINE "))
+            return op::materialize;
+        else if (d.starts_with("MULTI-INDEX OR") || d.starts_with("INDEX "))
+            return op::multi_index;
+        else if (d.starts_with("BLOOM FILTER "))
+            return op::bloom_filter;
+        else
+            return op::other;
+    }
+
+    string_view query_plan::node::table() const noexcept {
+        string_view d = detail;
+        if (d.starts_with("SCAN "))
+            d.remove_prefix(5);
+        else if (d.starts_with("SEARCH "))
+            d.remove_prefix(7);
+        else
+            return {};
+        if (d == "CONSTANT ROW")
+            return {};
+        return d.substr(0, d.find(' '));
+    }
+
+    string_view query_plan::node::index() const noexcept {
+        string_view d = detail;
+        auto pos = d.find(" USING ");
+        if (pos == string_view::npos || table().empty())
+            return {};
+        d.remove_prefix(pos + 7);
+        if (d.starts_with("INTEGER PRIMARY KEY"))
+            return d.substr(0, 19);
+        else if (d.starts_with("PRIMARY KEY"))          // WITHOUT ROWID table
+            return d.substr(0, 11);
+        else if (d.starts_with("AUTOMATIC "))
+            return {};
+        else if (pos = d.find("INDEX "); pos != string_view::npos) {
+            d.remove_prefix(pos + 6);
+            return d.substr(0, d.find(' '));
+        }
+        return {};
+    }
+
+    bool query_plan::node::is_full_scan() const noexcept {
+        if (kind() != op::scan)
+            return false;
+        string_view t = table();
+        return !t.empty() && !t.starts_with('(') && detail.find(" VIRTUAL TABLE ") == string::npos;
+    }
+
+    bool query_plan::node::is_automatic_index() const noexcept {
+        return table().size() > 0 && detail.find(" USING AUTOMATIC ") != string::npos;
+    }
+
+    vector<query_plan::node const*> query_plan::children(int parent) const {
+        vector<node const*> result;
+        for (node const& n : nodes_)
+            if (n.parent == parent)
+                result.push_back(&n);
+        return result;
+    }
+
+    vector<query_plan::node const*> query_plan::full_scans() const {
+        vector<node const*> result;
+        for (node const& n : nodes_)
+            if (n.is_full_scan())
+                result.push_back(&n);
+        return result;
+    }
+
+    bool query_plan::has_full_scan() const noexcept {
+        return ranges::any_of(nodes_, &node::is_full_scan);
+    }
+
+    bool query_plan::uses_automatic_index() const noexcept {
+        return ranges::any_of(nodes_, &node::is_automatic_index);
+    }
+
+    bool query_plan::uses_temp_btree() const noexcept {
+        return ranges::any_of(nodes_, [](node const& n) {
+            return n.detail.find("TEMP B-TREE") != string::npos;
+        });
+    }
+
+    bool query_plan::uses_index(string_view table, string_view index) const noexcept {
+        return ranges::any_of(nodes_, [&](node const& n) {
+            return n.table() == table && n.index() == index;
+        });
+    }
+
+    string query_plan::to_string() const {
+        string result;
+        unordered_map<int, int> depths;     // node id -> depth in tree
+        for (node const& n : nodes_) {
+            auto i = depths.find(n.parent);
+            int depth = (i != depths.end()) ? i->second + 1 : 0;
+            depths[n.id] = depth;
+            result.append(2 * depth, ' ');
+            result += n.detail;
+            result += '\n';
+        }
+        return result;
+    }
+
 }
@@ -0,0 +1,154 @@
+// sqnice/row_stream.cc
+//
+// The MIT License
+//
+// Copyright (c) 2015 Wongoo Lee (iwongu at gmail dot com)
+// Copyright (c) 2024 Jens Alfke (Github: snej)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include "sqnice/row_stream.hh"
+#include <cassert>
+#include <stdexcept>
+
+#ifdef SQNICE_LOADABLE_EXTENSION
+#  include <sqlite3ext.h>
+SQLITE_EXTENSION_INIT1
+#else
+#  include <sqlite3.h>
+#endif
+
+namespace sqnice {
+    using namespace std;
+
+
+    row_stream_base::row_stream_base(query& q, size_t batch_rows, size_t max_batches,
+                                     unsigned ncolumns)
+    :batch_rows_(batch_rows)
+    ,max_batches_(max_batches)
+    ,row_(nullptr)
+    ,exceptions_(q.exceptions())
+    {
+        if (batch_rows == 0 || max_batches == 0)
+            throw invalid_argument("row_stream: batch size and count must be nonzero");
+        if (unsigned n = q.column_count(); n < ncolumns)
+            throw invalid_argument(format("query has %u columns, but row_stream expects %u",
+                                          n, ncolumns));
+        impl_ = q.give_impl(this);   // throws if the query is in use
+        row_ = query::row(impl_->stmt);
+    }
+
+
+    row_stream_base::~row_stream_base() {
+        stop();
+    }
+
+
+    void row_stream_base::start() {
+        thread_ = thread([this] {run();});
+    }
+
+
+    void row_stream_base::stop() noexcept {
+        if (thread_.joinable()) {
+            {
+                unique_lock lock(mutex_);
+                cancelled_ = true;
+            }
+            cond_.notify_all();
+            thread_.join();
+        }
+        if (impl_) {
+            sqlite3_reset(impl_->stmt);
+            impl_->transfer_owner(this, nullptr);   // return the statement to the query
+            impl_ = nullptr;
+        }
+    }
+
+
+    bool row_stream_base::step() {
+        rc_ = status{sqlite3_step(impl_->stmt)};
+        if (rc_ == status::row)
+            return true;
+        if (rc_ != status::done && exceptions_)
+            checking::raise(rc_, sqlite3_errmsg(sqlite3_db_handle(impl_->stmt)));
+        return false;
+    }
+
+
+#pragma mark - PRODUCER THREAD:
+
+
+    void row_stream_base::run() noexcept {
+        try {
+            bool more = true;
+            while (more) {
+                size_t slot;
+                {
+                    unique_lock lock(mutex_);
+                    cond_.wait(lock, [&] {return cancelled_ || count_ < max_batches_;});
+                    if (cancelled_)
+                        break;
+                    slot = (head_ + count_) % max_batches_;
+                }
+                more = fill_batch(slot);
+                {
+                    unique_lock lock(mutex_);
+                    ++count_;
+                }
+                cond_.notify_all();
+            }
+        } catch (...) {
+            unique_lock lock(mutex_);
+            error_ = current_exception();
+        }
+        {
+            unique_lock lock(mutex_);
+            finished_ = true;
+        }
+        cond_.notify_all();
+    }
+
+
+#pragma mark - CONSUMER:
+
+
+    size_t row_stream_base::next_batch() {
+        unique_lock lock(mutex_);
+        cond_.wait(lock, [&] {return count_ > 0 || finished_;});
+        if (count_ > 0)
+            return head_;
+        else if (error_)
+            rethrow_exception(std::exchange(error_, nullptr));
+        else
+            return npos;
+    }
+
+
+    void row_stream_base::release_batch() {
+        {
+            unique_lock lock(mutex_);
+            assert(count_ > 0);
+            head_ = (head_ + 1) % max_batches_;
+            --count_;
+        }
+        cond_.notify_all();
+    }
+
+}
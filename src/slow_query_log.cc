@@ -0,0 +1,297 @@
+// sqnice/slow_query_log.cc
+//
+// The MIT License
+//
+// Copyright (c) 2015 Wongoo Lee (iwongu at gmail dot com)
+// Copyright (c) 2024 Jens Alfke (Github: snej)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include "sqnice/slow_query_log.hh"
+#include "sqnice/latency_histogram.hh"
+#include "sqnice/query.hh"
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <unordered_map>
+
+#ifdef SQNICE_LOADABLE_EXTENSION
+#  include <sqlite3ext.h>
+SQLITE_EXTENSION_INIT1
+#else
+#  include <sqlite3.h>
+#endif
+
+namespace sqnice {
+    using namespace std;
+
+
+    // True while this thread is running EXPLAIN QUERY PLAN, so its own profile is ignored.
+    static thread_local bool tExplaining = false;
+
+
+    // Runs `EXPLAIN QUERY PLAN` on a statement's SQL, returning the plan as indented lines.
+    // (This can't use `statement::plan`, since the statement has no `database` object.)
+    static string explain_query_plan(sqlite3_stmt* stmt) {
+        const char* sql = sqlite3_sql(stmt);
+        if (!sql || sqlite3_stmt_isexplain(stmt))
+            return "";
+        string eqp = string("EXPLAIN QUERY PLAN ") + sql;
+        vector<query_plan::node> nodes;
+        sqlite3_stmt* explain = nullptr;
+        tExplaining = true;
+        if (sqlite3_prepare_v2(sqlite3_db_handle(stmt), eqp.c_str(), -1, &explain, nullptr)
+                == SQLITE_OK && explain) {
+            while (sqlite3_step(explain) == SQLITE_ROW) {
+                auto detail = (const char*)sqlite3_column_text(explain, 3);
+                nodes.push_back({sqlite3_column_int(explain, 0), sqlite3_column_int(explain, 1),
+                                 detail ? detail : ""});
+            }
+        }
+        sqlite3_finalize(explain);
+        tExplaining = false;
+        return query_plan(std::move(nodes)).to_string();
+    }
+
+
+#pragma mark - STATE:
+
+
+    class slow_query_log::state {
+    public:
+        state(duration threshold, size_t max_slow_queries)
+        :threshold_(threshold.count())
+        ,max_slow_queries_(max_slow_queries)
+        { }
+
+        duration threshold() const noexcept {
+            return duration(threshold_.load(memory_order_relaxed));
+        }
+        void set_threshold(duration t) noexcept {threshold_.store(t.count(), memory_order_relaxed);}
+
+        // The profile handler.
+        void record(statement_profile const& prof) {
+            if (tExplaining)
+                return;
+            bool slow = prof.duration >= threshold();
+            string expanded;
+            if (slow) [[unlikely]]
+                expanded = prof.expanded_sql();
+
+            string shape_to_explain;
+            {
+                unique_lock lock(mutex_);
+                auto& [text, sh] = shape_for(prof.sql());
+                sh.histogram.record(prof.duration);
+                if (slow) [[unlikely]] {
+                    ++sh.slow_count;
+                    slow_queries_.push_back({std::move(expanded), prof.duration,
+                                             chrono::system_clock::now()});
+                    if (slow_queries_.size() > max_slow_queries_)
+                        slow_queries_.pop_front();
+                    if (!sh.explained) {
+                        sh.explained = true;
+                        shape_to_explain = text;
+                    }
+                }
+            }
+
+            if (!shape_to_explain.empty()) {
+                // Run EXPLAIN outside the lock, then save the result:
+                string plan = explain_query_plan(prof.stmt);
+                unique_lock lock(mutex_);
+                if (auto i = shapes_.find(shape_to_explain); i != shapes_.end())
+                    i->second.plan = std::move(plan);
+            }
+        }
+
+        vector<slow_query> slow_queries() const {
+            unique_lock lock(mutex_);
+            return vector<slow_query>(slow_queries_.begin(), slow_queries_.end());
+        }
+
+        vector<query_shape_stats> shapes() const {
+            vector<query_shape_stats> result;
+            {
+                unique_lock lock(mutex_);
+                result.reserve(shapes_.size());
+                for (auto& [text, sh] : shapes_) {
+                    result.push_back({
+                        .shape      = text,
+                        .count      = sh.histogram.count(),
+                        .slow_count = sh.slow_count,
+                        .total      = sh.histogram.total(),
+                        .p50        = sh.histogram.percentile(0.50),
+                        .p99        = sh.histogram.percentile(0.99),
+                        .max        = sh.histogram.max(),
+                        .plan       = sh.plan,
+                    });
+                }
+            }
+            ranges::sort(result, greater{}, &query_shape_stats::total);
+            return result;
+        }
+
+        void clear() {
+            unique_lock lock(mutex_);
+            by_sql_.clear();
+            shapes_.clear();
+            slow_queries_.clear();
+        }
+
+    private:
+        static constexpr size_t kMaxShapes = 1000;          // Beyond this, shapes are lumped
+        static constexpr size_t kMaxSQLs   = 10000;         // Max entries in `by_sql_`
+
+        struct shape {
+            latency_histogram   histogram;
+            uint64_t            slow_count = 0;
+            bool                explained = false;
+            string              plan;
+        };
+
+        struct string_hash {
+            using is_transparent = void;
+            size_t operator()(string_view s) const noexcept {return hash<string_view>{}(s);}
+        };
+
+        // Returns the shape of a statement's SQL. Must be called with the mutex locked.
+        pair<const string, shape>& shape_for(string_view sql) {
+            if (auto i = by_sql_.find(sql); i != by_sql_.end()) [[likely]]
+                return *i->second;
+            auto j = shapes_.try_emplace(normalize_sql(sql)).first;
+            if (shapes_.size() > kMaxShapes && j->second.histogram.count() == 0) {
+                shapes_.erase(j);
+                j = shapes_.try_emplace("(other)").first;
+            }
+            if (by_sql_.size() < kMaxSQLs)
+                by_sql_.emplace(string(sql), &*j);
+            return *j;
+        }
+
+        using shape_map = unordered_map<string, shape>;
+
+        atomic<int64_t>                 threshold_;     // Slow threshold in nanoseconds
+        size_t const                    max_slow_queries_;
+        mutable mutex                   mutex_;
+        shape_map                       shapes_;        // Normalized SQL -> shape
+        unordered_map<string, shape_map::value_type*, string_hash, equal_to<>> by_sql_;
+        deque<slow_query>               slow_queries_;  // Most recent slow queries
+    };
+
+
+#pragma mark - SLOW QUERY LOG:
+
+
+    slow_query_log::slow_query_log(duration threshold, size_t max_slow_queries)
+    :state_(make_shared<state>(threshold, max_slow_queries))
+    { }
+
+    void slow_query_log::attach(database& db) {
+        db.set_profile_handler([state = state_, next = db.get_profile_handler()]
+                               (statement_profile const& prof) {
+            state->record(prof);
+            if (next)
+                next(prof);
+        });
+    }
+
+    slow_query_log::duration slow_query_log::threshold() const noexcept {
+        return state_->threshold();
+    }
+
+    void slow_query_log::set_threshold(duration t) noexcept {state_->set_threshold(t);}
+    vector<slow_query> slow_query_log::slow_queries() const {return state_->slow_queries();}
+    vector<query_shape_stats> slow_query_log::shapes() const     {return state_->shapes();}
+    void slow_query_log::clear()                                 {state_->clear();}
+
+
+    string slow_query_log::normalize_sql(string_view sql) {
+        auto is_ident_char = [](char c) {
+            return isalnum(uint8_t(c)) || c == '_' || c == '$' || (c & 0x80);
+        };
+        auto after_ident = [&](string const& out) {
+            return !out.empty() && is_ident_char(out.back());
+        };
+        string out;
+        out.reserve(sql.size());
+        bool space = false;
+        size_t i = 0, n = sql.size();
+        while (i < n) {
+            char c = sql[i];
+            if (isspace(uint8_t(c))) {
+                space = true;
+                ++i;
+                continue;
+            }
+            if (space && !out.empty())
+                out += ' ';
+            space = false;
+
+            bool blob = (c == 'x' || c == 'X') && i + 1 < n && sql[i+1] == '\''
+                            && !after_ident(out);
+            if (c == '\'' || blob) {
+                // String or blob literal; a doubled quote is an escaped quote:
+                i = sql.find('\'', i) + 1;
+                while (i < n) {
+                    if (sql[i] == '\'') {
+                        if (i + 1 < n && sql[i+1] == '\'') {
+                            i += 2;
+                            continue;
+                        }
+                        ++i;
+                        break;
+                    }
+                    ++i;
+                }
+                out += '?';
+            } else if ((isdigit(uint8_t(c)) || (c == '.' && i + 1 < n
+                                                 && isdigit(uint8_t(sql[i+1]))))
+                       && !after_ident(out)) {
+                // Numeric literal, including hex and exponents:
+                ++i;
+                while (i < n && (is_ident_char(sql[i]) || sql[i] == '.'
+                                 || ((sql[i] == '+' || sql[i] == '-')
+                                     && (sql[i-1] == 'e' || sql[i-1] == 'E'))))
+                    ++i;
+                out += '?';
+            } else if (c == '"' || c == '`' || c == '[') {
+                // Quoted identifier; copy it as-is:
+                char close = (c == '[') ? ']' : c;
+                size_t end = sql.find(close, i + 1);
+                end = (end == string_view::npos) ? n : end + 1;
+                out.append(sql.substr(i, end - i));
+                i = end;
+            } else if (c == '?' || c == ':' || c == '@' || (c == '$' && !after_ident(out))) {
+                // Parameter; normalize its name/number to `?`:
+                ++i;
+                while (i < n && is_ident_char(sql[i]))
+                    ++i;
+                out += '?';
+            } else {
+                out += c;
+                ++i;
+            }
+        }
+        return out;
+    }
+
+}
@@ -27,8 +27,12 @@
 #ifndef SQNICE_STATEMENT_CACHE_H
 #define SQNICE_STATEMENT_CACHE_H
 
+#include "sqnice/database.hh"
 #include "sqnice/query.hh"
-#include <tuple>
+#include <algorithm>
+#include <forward_list>
+#include <list>
+#include <string>
 #include <unordered_map>
 
 ASSUME_NONNULL_BEGIN
@@ -41,6 +45,15 @@ namespace sqnice {
           to destruct them all before closing the database, else it doesn't close cleanly;
           destructing the cache destructs all of them at once.
 
+        A `sqlite3_stmt` can only be used by one statement object or query iterator at a time.
+        So the cache can hold several instances of the same SQL statement: if all the existing
+        instances are in use, as in a nested loop over the same query, it compiles another one,
+        up to `max_instances()` per SQL string.
+
+        The cache has a maximum capacity; when it's full, the least recently used statements are
+        evicted. (If a statement is still in use, because a copy of it or a query iterator
+        still exists, its `sqlite3_stmt` isn't finalized until they're done with it.)
+
         The `database` class already has two instances of this, storing the compiled commands
         and queries returned by the `command()` and `query()` methods, so you usually don't need
         to use this template directly. */
@@ -48,33 +61,161 @@ namespace sqnice {
     template <class STMT>
     class statement_cache : public checking {
     public:
-        explicit statement_cache(database &db) noexcept :checking(db) { }
-
-        /// Compiles a STMT, or returns a copy of an already-compiled one with the same SQL string.
-        /// @warning  If two returned STMTs with the same string are in scope at the same time,
-        ///           they won't work right because they are using the same `sqlite3_stmt`.
-        STMT compile(std::string const& sql) {
-            const STMT* stmt;
-            if (auto i = stmts_.find(sql); i != stmts_.end()) {
-                stmt = &i->second;
+        /// The default maximum number of instances of the same SQL statement.
+        static constexpr unsigned kDefaultMaxInstances = 4;
+
+        explicit statement_cache(database &db,
+                                 size_t capacity = database::kDefaultStatementCacheCapacity) noexcept
+        :checking(db), capacity_(capacity) { }
+
+        /// Compiles a STMT, or returns a copy of an already-compiled one with the same SQL string
+        /// that isn't currently in use. If all the cached instances of that SQL are in use, and
+        /// there are already `max_instances()` of them, returns a new uncached STMT.
+        STMT compile(std::string_view sql) {
+            if (STMT* stmt = acquire(sql)) [[likely]] {
+                STMT result = *stmt;
+                trim();
+                return result;
             } else {
-                auto x = stmts_.emplace(std::piecewise_construct,
-                                        std::tuple<std::string>{sql},
-                                        std::tuple<statement_cache<STMT>&,const char*,statement::persistence>{
-                                                *this, sql.c_str(), statement::persistent});
-                stmt = &x.first->second;
+                return STMT(*this, sql);
             }
+        }
+
+        /// Like `compile`, but returns a reference to a cached STMT instead of a copy.
+        /// This avoids the overhead of copying, but the STMT's bindings are not cleared.
+        /// @warning  The reference remains valid only until the STMT is evicted from the cache,
+        ///           which can happen after `capacity()` more cache misses.
+        /// @throws std::logic_error if `max_instances()` instances are all in use.
+        STMT& borrow(std::string_view sql) {
+            STMT* stmt = acquire(sql);
+            if (!stmt) [[unlikely]]
+                throw std::logic_error("too many instances of a cached statement are in use");
+            trim(1);
             return *stmt;
         }
 
-        STMT operator[] (std::string const& sql)        {return compile(std::string(sql));}
-        STMT operator[] (const char *sql)               {return compile(sql);}
+        STMT operator[] (std::string_view sql)          {return compile(sql);}
+
+        /// The maximum number of statements the cache will hold.
+        size_t capacity() const noexcept                {return capacity_;}
+
+        /// Changes the capacity, evicting least recently used statements if necessary.
+        /// A capacity of 0 disables caching: every `compile` call compiles a new statement.
+        void set_capacity(size_t capacity) {
+            capacity_ = capacity;
+            trim();
+        }
+
+        /// The maximum number of instances of the same SQL statement the cache will hold.
+        unsigned max_instances() const noexcept         {return max_instances_;}
+        void set_max_instances(unsigned n) noexcept     {max_instances_ = std::max(n, 1u);}
+
+        /// The number of statements currently cached, including multiple instances of the same SQL.
+        size_t size() const noexcept                    {return size_;}
+
+        /// Returns the cache's statistics, including the memory used by its statements.
+        statement_cache_stats stats() const noexcept {
+            statement_cache_stats s {
+                .capacity = capacity_,
+                .count = size_,
+                .hits = hits_,
+                .misses = misses_,
+                .evictions = evictions_,
+            };
+            for (entry const& e : lru_)
+                for (STMT const& stmt : e.instances)
+                    s.memory_used += stmt.memory_used();
+            return s;
+        }
+
+        /// Calls `fn(STMT const&)` for each cached statement, including each instance of the
+        /// same SQL, from most to least recently used.
+        template <typename FN>
+        void each_statement(FN const& fn) const {
+            for (entry const& e : lru_)
+                for (STMT const& stmt : e.instances)
+                    fn(stmt);
+        }
 
         /// Empties the cache, freeing all statements.
-        void clear()                                    {stmts_.clear();}
+        void clear() {
+            index_.clear();
+            lru_.clear();
+            size_ = 0;
+        }
 
     private:
-        std::unordered_map<std::string,STMT> stmts_;
+        struct entry {
+            entry(statement_cache& cache, std::string_view s)
+            :sql(s) {
+                instances.emplace_front(cache, sql, statement::persistent);
+            }
+            std::string const       sql;
+            std::forward_list<STMT> instances;
+            unsigned                count = 1;
+        };
+        using entry_list = std::list<entry>;
+
+        // True if no other object is using this cached STMT.
+        static bool idle(STMT const& stmt) noexcept {
+            auto& impl = static_cast<statement const&>(stmt).impl_;
+            return impl.use_count() == 1 && (!impl->owned() || impl->owned_by(&stmt));
+        }
+
+        // Returns an idle STMT for `sql`, compiling one if necessary, or returns nullptr if
+        // `max_instances_` are all in use. Moves the entry to the front of the LRU list.
+        STMT* _Nullable acquire(std::string_view sql) {
+            if (auto i = index_.find(sql); i != index_.end()) {
+                entry& e = *i->second;
+                lru_.splice(lru_.begin(), lru_, i->second);     // move to front (most recent)
+                for (STMT& stmt : e.instances) {
+                    if (idle(stmt)) [[likely]] {
+                        ++hits_;
+                        stmt.reset();   // in case it was left owning its sqlite3_stmt
+                        return &stmt;
+                    }
+                }
+                ++misses_;
+                if (e.count >= max_instances_)
+                    return nullptr;
+                e.instances.emplace_front(*this, e.sql, statement::persistent);
+                ++e.count;
+                ++size_;
+                return &e.instances.front();
+            }
+            ++misses_;
+            lru_.emplace_front(*this, sql);
+            try {
+                index_.emplace(lru_.front().sql, lru_.begin());
+            } catch (...) {
+                lru_.pop_front();
+                throw;
+            }
+            ++size_;
+            return &lru_.front().instances.front();
+        }
+
+        // Evicts least recently used entries until the size is within the capacity
+        // (but never evicts the last `min_entries` entries.)
+        void trim(size_t min_entries = 0) {
+            while (size_ > capacity_ && lru_.size() > min_entries) {
+                entry& e = lru_.back();
+                size_ -= e.count;
+                evictions_ += e.count;
+                index_.erase(e.sql);
+                lru_.pop_back();
+            }
+        }
+
+        entry_list                                                      lru_;   // MRU first
+        std::unordered_map<std::string_view,typename entry_list::iterator> index_; // keys in lru_
+        size_t                                                          size_ = 0;
+        size_t                                                          capacity_;
+        unsigned                                                        max_instances_
+                                                                            = kDefaultMaxInstances;
+        uint64_t                                                        hits_ = 0;
+        uint64_t                                                        misses_ = 0;
+        uint64_t                                                        evictions_ = 0;
     };
 
     /** A cache of pre-compiled `command` objects. */
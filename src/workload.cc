@@ -0,0 +1,733 @@
+// sqnice/workload.cc
+//
+// The MIT License
+//
+// Copyright (c) 2015 Wongoo Lee (iwongu at gmail dot com)
+// Copyright (c) 2024 Jens Alfke (Github: snej)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include "sqnice/workload.hh"
+#include "sqnice/query.hh"
+#include "bind_capture.hh"
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <charconv>
+#include <cmath>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+#ifdef SQNICE_LOADABLE_EXTENSION
+#  include <sqlite3ext.h>
+SQLITE_EXTENSION_INIT1
+#else
+#  include <sqlite3.h>
+#endif
+
+namespace sqnice {
+    using namespace std;
+    using namespace std::chrono;
+
+
+    // Log file format: the magic header, followed by records, each starting with a tag byte:
+    //   kDefineSQL:  varint ID, varint length, UTF-8 SQL     (IDs are assigned from 0 up)
+    //   kExecute:    varint sequence, varint connection, varint SQL ID, varint start ns,
+    //                varint duration ns, varint parameter count, parameters
+    //   kUnreplayable: the same as kExecute, but the statement's parameters couldn't be
+    //                recorded, so the parameter count is 0.
+    // Execute records appear in sequence order, which is the order the statements finished.
+    // A parameter is a `data_type` byte followed by: integer: zigzag varint; floating_point:
+    // 8 bytes of IEEE double, little-endian; text/blob: varint length + bytes; null: nothing.
+    static constexpr char     kMagic[8] = {'S','Q','N','W','K','L','D','3'};
+    static constexpr uint8_t  kDefineSQL = 1, kExecute = 2, kUnreplayable = 3;
+
+
+    static void append_varint(string& out, uint64_t n) {
+        while (n >= 0x80) {
+            out += char(n | 0x80);
+            n >>= 7;
+        }
+        out += char(n);
+    }
+
+    static void append_value(string& out, workload_value const& value) {
+        visit([&](auto const& v) {
+            using T = decay_t<decltype(v)>;
+            if constexpr (is_same_v<T, nullptr_t>) {
+                out += char(data_type::null);
+            } else if constexpr (is_same_v<T, int64_t>) {
+                out += char(data_type::integer);
+                append_varint(out, (uint64_t(v) << 1) ^ uint64_t(v >> 63));    // zigzag
+            } else if constexpr (is_same_v<T, double>) {
+                out += char(data_type::floating_point);
+                auto bits = bit_cast<uint64_t>(v);
+                for (int i = 0; i < 8; ++i)
+                    out += char(bits >> (8 * i));
+            } else {
+                out += char(is_same_v<T, string> ? data_type::text : data_type::blob);
+                append_varint(out, v.size());
+                out.append(reinterpret_cast<const char*>(v.data()), v.size());
+            }
+        }, value);
+    }
+
+
+#pragma mark - PARAMETER CAPTURE:
+
+
+    // A statement's current bindings, as reported to `bind_capture`.
+    struct captured_bindings {
+        enum state : uint8_t {unknown, known, unrecordable};
+        vector<workload_value>  values;     // Indexed by parameter number - 1
+        vector<state>           states;
+    };
+
+    static mutex sCaptureMutex;
+    static unordered_map<sqlite3_stmt*, captured_bindings> sCaptured;
+
+    // Calls `fn` on the entry for `stmt` (creating it with all states `unknown`), under the
+    // mutex. If that fails, e.g. out of memory, the entry is removed, so it's not stale.
+    template <typename Fn>
+    static void update_capture(sqlite3_stmt* stmt, Fn fn) noexcept {
+        unique_lock lock(sCaptureMutex);
+        try {
+            auto [i, created] = sCaptured.try_emplace(stmt);
+            if (created) {
+                size_t n = size_t(sqlite3_bind_parameter_count(stmt));
+                i->second.values.resize(n);
+                i->second.states.assign(n, captured_bindings::unknown);
+            }
+            fn(i->second);
+        } catch (...) {
+            sCaptured.erase(stmt);
+        }
+    }
+
+    void bind_capture::start() noexcept {
+        ++sActive;
+    }
+
+    void bind_capture::stop() noexcept {
+        if (--sActive == 0) {
+            // Forget everything, since bindings made from now on won't be captured:
+            unique_lock lock(sCaptureMutex);
+            sCaptured.clear();
+        }
+    }
+
+    void bind_capture::prepared(sqlite3_stmt* stmt) noexcept {
+        cleared(stmt);
+    }
+
+    void bind_capture::cleared(sqlite3_stmt* stmt) noexcept {
+        update_capture(stmt, [](captured_bindings& b) {
+            ranges::fill(b.values, nullptr);
+            ranges::fill(b.states, captured_bindings::known);
+        });
+    }
+
+    void bind_capture::bound(sqlite3_stmt* stmt, int idx, workload_value value) noexcept {
+        update_capture(stmt, [&](captured_bindings& b) {
+            if (idx >= 1 && size_t(idx) <= b.values.size()) {
+                b.values[idx - 1] = std::move(value);
+                b.states[idx - 1] = captured_bindings::known;
+            }
+        });
+    }
+
+    void bind_capture::bound_unrecordable(sqlite3_stmt* stmt, int idx) noexcept {
+        update_capture(stmt, [&](captured_bindings& b) {
+            if (idx >= 1 && size_t(idx) <= b.values.size())
+                b.states[idx - 1] = captured_bindings::unrecordable;
+        });
+    }
+
+    void bind_capture::finalized(sqlite3_stmt* stmt) noexcept {
+        unique_lock lock(sCaptureMutex);
+        sCaptured.erase(stmt);
+    }
+
+    bind_capture::result bind_capture::get(sqlite3_stmt* stmt, vector<workload_value>& params) {
+        unique_lock lock(sCaptureMutex);
+        auto i = sCaptured.find(stmt);
+        if (i == sCaptured.end())
+            return incomplete;
+        auto& b = i->second;
+        if (ranges::find(b.states, captured_bindings::unrecordable) != b.states.end())
+            return unrecordable;
+        if (ranges::find(b.states, captured_bindings::unknown) != b.states.end())
+            return incomplete;
+        params = b.values;
+        return complete;
+    }
+
+
+#pragma mark - PARAMETER RECOVERY:
+
+
+    // SQLite has no API to read back a statement's bindings, but `sqlite3_expanded_sql`
+    // substitutes them into the SQL as literals. The functions below find the parameters in the
+    // original SQL the way SQLite does, and parse the literals at the same spots in the
+    // expanded SQL.
+
+    static bool is_id_char(char c) {
+        return isalnum(uint8_t(c)) || c == '_' || c == '$' || (c & 0x80);
+    }
+
+    // Finds the next parameter token in `sql` at or after `pos`, skipping strings, quoted
+    // identifiers and comments. Returns its start and sets `len`, or returns npos.
+    static size_t next_parameter(string_view sql, size_t pos, size_t& len) {
+        size_t n = sql.size();
+        auto skip_to = [&](size_t from, string_view end) {
+            size_t e = sql.find(end, from);
+            return (e == string_view::npos) ? n : e + end.size();
+        };
+        while (pos < n) {
+            char c = sql[pos];
+            if (c == '\'' || c == '"' || c == '`') {
+                pos = skip_to(pos + 1, string_view(&c, 1));     // a doubled quote just
+            } else if (c == '[') {                              // restarts the quoted part
+                pos = skip_to(pos + 1, "]");
+            } else if (c == '-' && pos + 1 < n && sql[pos+1] == '-') {
+                pos = skip_to(pos + 2, "\n");
+            } else if (c == '/' && pos + 1 < n && sql[pos+1] == '*') {
+                pos = skip_to(pos + 2, "*/");
+            } else if (c == '?') {
+                len = 1;
+                while (pos + len < n && isdigit(uint8_t(sql[pos + len])))
+                    ++len;
+                return pos;
+            } else if ((c == ':' || c == '@' || c == '$') && pos + 1 < n
+                            && is_id_char(sql[pos+1])) {
+                size_t i = pos + 1;
+                while (i < n) {
+                    if (is_id_char(sql[i]))
+                        ++i;
+                    else if (sql[i] == ':' && i + 1 < n && sql[i+1] == ':')
+                        i += 2;
+                    else if (sql[i] == '(')
+                        i = skip_to(i + 1, ")");
+                    else
+                        break;
+                }
+                len = i - pos;
+                return pos;
+            } else if (is_id_char(c)) {
+                while (pos < n && is_id_char(sql[pos]))        // identifier, keyword or number
+                    ++pos;
+            } else {
+                ++pos;
+            }
+        }
+        return string_view::npos;
+    }
+
+    // Parses a literal written by `sqlite3_expanded_sql` at `pos`, advancing `pos` past it.
+    static bool parse_literal(string_view s, size_t& pos, workload_value& out) {
+        string_view rest = s.substr(pos);
+        if (rest.starts_with("NULL")) {
+            out = nullptr;
+            pos += 4;
+        } else if (rest.starts_with("'")) {
+            string text;
+            size_t i = 1;
+            while (true) {
+                if (i >= rest.size())
+                    return false;
+                if (rest[i] == '\'') {
+                    if (i + 1 < rest.size() && rest[i+1] == '\'')
+                        ++i;
+                    else
+                        break;
+                }
+                text += rest[i++];
+            }
+            out = std::move(text);
+            pos += i + 1;
+        } else if (rest.starts_with("x'") || rest.starts_with("X'")) {
+            size_t end = rest.find('\'', 2);
+            if (end == string_view::npos || end % 2 != 0)
+                return false;
+            vector<byte> bytes((end - 2) / 2);
+            for (size_t i = 0; i < bytes.size(); ++i) {
+                unsigned b;
+                if (from_chars(&rest[2 + 2*i], &rest[4 + 2*i], b, 16).ec != errc{})
+                    return false;
+                bytes[i] = byte(b);
+            }
+            out = std::move(bytes);
+            pos += end + 1;
+        } else if (rest.starts_with("zeroblob(")) {
+            size_t n;
+            auto [end, ec] = from_chars(rest.data() + 9, rest.data() + rest.size(), n);
+            if (ec != errc{} || end == rest.data() + rest.size() || *end != ')')
+                return false;
+            out = vector<byte>(n);
+            pos += size_t(end - rest.data()) + 1;
+        } else {
+            bool negative = rest.starts_with("-");
+            size_t i = negative;
+            if (rest.substr(i).starts_with("Inf")) {
+                out = negative ? -HUGE_VAL : HUGE_VAL;
+                pos += i + 3;
+                return true;
+            }
+            bool real = false;
+            while (i < rest.size()) {
+                char c = rest[i];
+                if (c == '.' || c == 'e' || c == 'E')
+                    real = true;
+                else if ((c == '-' || c == '+') && (rest[i-1] == 'e' || rest[i-1] == 'E'))
+                    { }
+                else if (!isdigit(uint8_t(c)))
+                    break;
+                ++i;
+            }
+            if (i == size_t(negative))
+                return false;
+            if (real) {
+                out = strtod(string(rest.substr(0, i)).c_str(), nullptr);
+            } else {
+                int64_t n;
+                if (from_chars(rest.data(), rest.data() + i, n).ec != errc{})
+                    return false;
+                out = n;
+            }
+            pos += i;
+        }
+        return true;
+    }
+
+    // Recovers a statement's bound parameter values, by matching its SQL with its expanded SQL.
+    static bool recover_parameters(sqlite3_stmt* stmt, vector<workload_value>& params) {
+        params.assign(size_t(sqlite3_bind_parameter_count(stmt)), nullptr);
+        if (params.empty())
+            return true;
+        const char* rawSQL = sqlite3_sql(stmt);
+        char* expandedSQL = sqlite3_expanded_sql(stmt);
+        if (!rawSQL || !expandedSQL) {
+            sqlite3_free(expandedSQL);
+            return false;
+        }
+        string_view sql = rawSQL, expanded = expandedSQL;
+        bool ok = true;
+        size_t pos = 0, epos = 0, len = 0;
+        int next_index = 1;
+        while (ok) {
+            size_t param = next_parameter(sql, pos, len);
+            // The text up to the parameter (or the end) must be the same in both:
+            string_view same = sql.substr(pos, min(param, sql.size()) - pos);
+            if (expanded.substr(epos, same.size()) != same) {
+                ok = false;
+                break;
+            }
+            epos += same.size();
+            if (param == string_view::npos)
+                break;
+
+            int idx;
+            if (len == 1)
+                idx = next_index;
+            else if (sql[param] == '?')
+                idx = atoi(string(sql.substr(param + 1, len - 1)).c_str());
+            else
+                idx = sqlite3_bind_parameter_index(stmt, string(sql.substr(param, len)).c_str());
+            next_index = max(idx + 1, next_index);
+            workload_value value;
+            ok = idx >= 1 && idx <= int(params.size()) && parse_literal(expanded, epos, value);
+            if (ok)
+                params[idx - 1] = std::move(value);
+            pos = param + len;
+        }
+        sqlite3_free(expandedSQL);
+        return ok && epos == expanded.size();
+    }
+
+
+#pragma mark - RECORDER:
+
+
+    class workload_recorder::state {
+    public:
+        explicit state(string_view path)
+        :file_(fopen(string(path).c_str(), "wb"))
+        {
+            if (!file_)
+                throw database_error(format("can't create workload log %.*s: %s",
+                                            int(path.size()), path.data(), strerror(errno))
+                                     .c_str(), status::cantopen);
+            setvbuf(file_, nullptr, _IOFBF, 64 * 1024);
+            write(kMagic, sizeof(kMagic));
+            bind_capture::start();
+        }
+
+        ~state() {
+            bind_capture::stop();
+            fclose(file_);
+        }
+
+        unsigned new_connection_id() noexcept       {return next_connection_++;}
+        uint64_t event_count() const noexcept       {return event_count_.load();}
+
+        // The profile handler.
+        void record(unsigned connection, statement_profile const& prof) {
+            static thread_local vector<workload_value> tParams;
+            static thread_local string tBuffer;
+            bool replayable;
+            switch (bind_capture::get(prof.stmt, tParams)) {
+                case bind_capture::complete:
+                    replayable = true;
+                    break;
+                case bind_capture::incomplete:
+                    // It was bound before recording began; fall back to the expanded SQL:
+                    replayable = recover_parameters(prof.stmt, tParams);
+                    break;
+                default:
+                    replayable = false;
+                    break;
+            }
+            if (!replayable) [[unlikely]] {
+                checking::log_warning("workload_recorder: couldn't record parameters of: %s",
+                                      string(prof.sql()).c_str());
+                tParams.clear();
+            }
+            tBuffer.clear();
+            append_varint(tBuffer, tParams.size());
+            for (auto& value : tParams)
+                append_value(tBuffer, value);
+
+            unique_lock lock(mutex_);
+            // Reading the clock under the lock makes the end times increase with the sequence,
+            // which `replay_workload` relies on.
+            auto start = max(prof.start, start_time_), end = max(steady_clock::now(), start);
+            string_view sql = prof.sql();
+            auto i = sql_ids_.find(sql);
+            if (i == sql_ids_.end()) {
+                i = sql_ids_.emplace(string(sql), sql_ids_.size()).first;
+                string def;
+                def += char(kDefineSQL);
+                append_varint(def, i->second);
+                append_varint(def, sql.size());
+                def += sql;
+                write(def.data(), def.size());
+            }
+            string header;
+            header += char(replayable ? kExecute : kUnreplayable);
+            append_varint(header, event_count_);
+            append_varint(header, connection);
+            append_varint(header, i->second);
+            append_varint(header, uint64_t(duration_cast<nanoseconds>(start - start_time_)
+                                               .count()));
+            append_varint(header, uint64_t(duration_cast<nanoseconds>(end - start).count()));
+            write(header.data(), header.size());
+            write(tBuffer.data(), tBuffer.size());
+            ++event_count_;
+        }
+
+        void flush() {
+            unique_lock lock(mutex_);
+            if (fflush(file_) != 0)
+                failed_ = true;
+            if (failed_)
+                throw database_error("error writing workload log", status::ioerr);
+        }
+
+    private:
+        struct string_hash {
+            using is_transparent = void;
+            size_t operator()(string_view s) const noexcept {return hash<string_view>{}(s);}
+        };
+
+        void write(const void* data, size_t size) {
+            if (!failed_ && fwrite(data, 1, size, file_) != size)
+                failed_ = true;
+        }
+
+        FILE*                                   file_;
+        steady_clock::time_point const          start_time_ = steady_clock::now();
+        atomic<unsigned>                        next_connection_ = 1;
+        atomic<uint64_t>                        event_count_ = 0;
+        mutex                                   mutex_;
+        unordered_map<string, uint64_t, string_hash, equal_to<>> sql_ids_;
+        bool                                    failed_ = false;
+    };
+
+
+    workload_recorder::workload_recorder(string_view path)
+    :state_(make_shared<state>(path))
+    { }
+
+    workload_recorder::~workload_recorder() {
+        try {
+            state_->flush();
+        } catch (database_error const& x) {
+            checking::log_warning("%s", x.what());
+        }
+    }
+
+    unsigned workload_recorder::attach(database& db) {
+        unsigned connection = state_->new_connection_id();
+        db.set_profile_handler([state = state_, connection, next = db.get_profile_handler()]
+                               (statement_profile const& prof) {
+            state->record(connection, prof);
+            if (next)
+                next(prof);
+        });
+        return connection;
+    }
+
+    void workload_recorder::flush()                     {state_->flush();}
+    uint64_t workload_recorder::event_count() const noexcept {return state_->event_count();}
+
+
+#pragma mark - READER:
+
+
+    workload_reader::workload_reader(string_view path)
+    :file_(fopen(string(path).c_str(), "rb"))
+    {
+        if (!file_)
+            throw database_error(format("can't open workload log %.*s: %s",
+                                        int(path.size()), path.data(), strerror(errno)).c_str(),
+                                 status::cantopen);
+        char magic[sizeof(kMagic)];
+        if (fread(magic, 1, sizeof(magic), file_) != sizeof(magic)
+                || memcmp(magic, kMagic, sizeof(magic)) != 0) {
+            fclose(file_);
+            throw database_error("not a workload log", status::corrupt);
+        }
+    }
+
+    workload_reader::~workload_reader() {
+        fclose(file_);
+    }
+
+    uint8_t workload_reader::read_byte() {
+        int c = getc(file_);
+        if (c == EOF)
+            throw database_error("workload log is truncated", status::corrupt);
+        return uint8_t(c);
+    }
+
+    uint64_t workload_reader::read_varint() {
+        uint64_t n = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            uint8_t b = read_byte();
+            n |= uint64_t(b & 0x7F) << shift;
+            if (!(b & 0x80))
+                return n;
+        }
+        throw database_error("invalid varint in workload log", status::corrupt);
+    }
+
+    void workload_reader::read_bytes(void* dst, size_t size) {
+        if (fread(dst, 1, size, file_) != size)
+            throw database_error("workload log is truncated", status::corrupt);
+    }
+
+    bool workload_reader::next(workload_event& event) {
+        while (true) {
+            int tag = getc(file_);
+            if (tag == EOF)
+                return false;
+            if (tag == kDefineSQL) {
+                if (read_varint() != sqls_.size())
+                    throw database_error("invalid SQL ID in workload log", status::corrupt);
+                string& sql = sqls_.emplace_back(read_varint(), '\0');
+                read_bytes(sql.data(), sql.size());
+            } else if (tag == kExecute || tag == kUnreplayable) {
+                event.replayable = (tag == kExecute);
+                event.sequence = read_varint();
+                event.connection = unsigned(read_varint());
+                uint64_t sql_id = read_varint();
+                if (sql_id >= sqls_.size())
+                    throw database_error("invalid SQL ID in workload log", status::corrupt);
+                event.sql = sqls_[sql_id];
+                event.start = nanoseconds(read_varint());
+                event.duration = nanoseconds(read_varint());
+                event.params.resize(read_varint());
+                for (auto& value : event.params) {
+                    switch (data_type(read_byte())) {
+                        case data_type::null:
+                            value = nullptr;
+                            break;
+                        case data_type::integer: {
+                            uint64_t z = read_varint();
+                            value = int64_t(z >> 1) ^ -int64_t(z & 1);
+                            break;
+                        }
+                        case data_type::floating_point: {
+                            uint64_t bits = 0;
+                            for (int i = 0; i < 8; ++i)
+                                bits |= uint64_t(read_byte()) << (8 * i);
+                            value = bit_cast<double>(bits);
+                            break;
+                        }
+                        case data_type::text: {
+                            string text(read_varint(), '\0');
+                            read_bytes(text.data(), text.size());
+                            value = std::move(text);
+                            break;
+                        }
+                        case data_type::blob: {
+                            vector<byte> bytes(read_varint());
+                            read_bytes(bytes.data(), bytes.size());
+                            value = std::move(bytes);
+                            break;
+                        }
+                        default:
+                            throw database_error("invalid value in workload log",
+                                                 status::corrupt);
+                    }
+                }
+                return true;
+            } else {
+                throw database_error("invalid record in workload log", status::corrupt);
+            }
+        }
+    }
+
+
+#pragma mark - REPLAY:
+
+
+    // Opens a connection for replaying one recorded connection.
+    static unique_ptr<database> open_replay_connection(string_view db_path,
+                                                       replay_options const& options) {
+        auto db = make_unique<database>(db_path, open_flags::readwrite);
+        // In serial replay, waiting on a lock held by another connection would never end:
+        db->set_busy_timeout(options.original_timing ? 5000 : 0);
+        if (options.on_open)
+            options.on_open(*db);
+        return db;
+    }
+
+    // Runs one recorded statement to completion.
+    static status replay_event(database& db, workload_event const& event) {
+        try {
+            sqnice::query q = db.query(event.sql);
+            for (size_t i = 0; i < event.params.size(); ++i) {
+                int idx = int(i + 1);
+                visit([&](auto const& v) {
+                    using T = decay_t<decltype(v)>;
+                    if constexpr (is_same_v<T, vector<byte>>)
+                        q.bind(idx, blob(v.data(), v.size()));
+                    else if constexpr (is_same_v<T, string>)
+                        q.bind(idx, string_view(v));
+                    else
+                        q.bind(idx, v);
+                }, event.params[i]);
+            }
+            for (auto row : q)
+                (void)row;
+            return status::ok;
+        } catch (database_error const& x) {
+            return x.error_code;
+        } catch (logic_error const&) {
+            return status::error;
+        }
+    }
+
+
+    replay_result replay_workload(string_view log_path,
+                                  string_view db_path,
+                                  replay_options const& options)
+    {
+        workload_reader reader(log_path);
+        replay_result result;
+        mutex callback_mutex;
+        auto run = [&](database& db, workload_event const& event) {
+            if (!event.replayable) {
+                unique_lock lock(callback_mutex);
+                ++result.skipped;
+                return;
+            }
+            auto start = steady_clock::now();
+            status rc = replay_event(db, event);
+            auto elapsed = duration_cast<nanoseconds>(steady_clock::now() - start);
+            unique_lock lock(callback_mutex);
+            ++result.statements;
+            if (!ok(rc))
+                ++result.errors;
+            if (options.on_statement)
+                options.on_statement(event, elapsed, rc);
+        };
+
+        auto start = steady_clock::now();
+        if (!options.original_timing) {
+            unordered_map<unsigned, unique_ptr<database>> connections;
+            workload_event event;
+            while (reader.next(event)) {
+                auto& db = connections[event.connection];
+                if (!db)
+                    db = open_replay_connection(db_path, options);
+                run(*db, event);
+            }
+        } else {
+            // Read the whole log, then start a thread per connection. The log is in sequence
+            // order, so the end times increase; an event must not start until every event
+            // that ended before it originally started has been replayed, or it might not see
+            // its effects. `completed` counts the leading events in the log that are done.
+            vector<workload_event> events;
+            vector<nanoseconds> ends;
+            unordered_map<unsigned, vector<size_t>> by_connection;
+            workload_event event;
+            while (reader.next(event)) {
+                by_connection[event.connection].push_back(events.size());
+                ends.push_back(event.start + event.duration);
+                events.push_back(std::move(event));
+            }
+            vector<bool> done(events.size());
+            size_t completed = 0;
+            mutex done_mutex;
+            condition_variable done_cond;
+
+            vector<thread> threads;
+            for (auto& [id, indexes] : by_connection) {
+                threads.emplace_back([&, &indexes = indexes] {
+                    auto db = open_replay_connection(db_path, options);
+                    for (size_t i : indexes) {
+                        workload_event const& e = events[i];
+                        this_thread::sleep_until(start + e.start);
+                        size_t after = size_t(ranges::lower_bound(ends, e.start) - ends.begin());
+                        {
+                            unique_lock lock(done_mutex);
+                            done_cond.wait(lock, [&] {return completed >= after;});
+                        }
+                        run(*db, e);
+                        unique_lock lock(done_mutex);
+                        done[i] = true;
+                        while (completed < done.size() && done[completed])
+                            ++completed;
+                        done_cond.notify_all();
+                    }
+                });
+            }
+            for (auto& t : threads)
+                t.join();
+        }
+        result.elapsed = duration_cast<nanoseconds>(steady_clock::now() - start);
+        return result;
+    }
+
+}
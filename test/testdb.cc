@@ -280,3 +280,660 @@ TEST_CASE("SQNice schema migration", "[sqnice]") {
 
     open_v2(0);
 }
+
+
+TEST_CASE_METHOD(sqnice_test, "SQNice statement cache", "[sqnice]") {
+    db.set_statement_cache_capacity(2);
+    auto stats = db.query_cache_stats();
+    CHECK(stats.capacity == 2);
+    CHECK(stats.count == 0);
+
+    (void)db.query("SELECT 1");
+    (void)db.query("SELECT 2");
+    (void)db.query("SELECT 1");
+    stats = db.query_cache_stats();
+    CHECK(stats.count == 2);
+    CHECK(stats.hits == 1);
+    CHECK(stats.misses == 2);
+    CHECK(stats.evictions == 0);
+    CHECK(stats.memory_used > 0);
+
+    // "SELECT 2" is least recently used, so it gets evicted:
+    (void)db.query("SELECT 3");
+    (void)db.query("SELECT 1");
+    stats = db.query_cache_stats();
+    CHECK(stats.count == 2);
+    CHECK(stats.hits == 2);
+    CHECK(stats.misses == 3);
+    CHECK(stats.evictions == 1);
+
+    // An evicted statement that's still in use keeps working:
+    db.execute("INSERT INTO contacts (name, phone) VALUES ('Mike', '555-1234')");
+    db.execute("INSERT INTO contacts (name, phone) VALUES ('Jane', '555-4321')");
+    sqnice::query q = db.query("SELECT name FROM contacts ORDER BY name");
+    int n = 0;
+    for (auto row : q) {
+        (void)db.query("SELECT 4");
+        (void)db.query("SELECT 5");
+        CHECK(string(row.get<const char*>(0)) == (n == 0 ? "Jane" : "Mike"));
+        ++n;
+    }
+    CHECK(n == 2);
+    CHECK(db.query_cache_stats().evictions == 4);
+
+    db.set_statement_cache_capacity(0);
+    CHECK(db.query_cache_stats().count == 0);
+    CHECK(db.query("SELECT 1").single_value<int>() == 1);
+    CHECK(db.query_cache_stats().count == 0);
+}
+
+
+TEST_CASE_METHOD(sqnice_test, "SQNice cached statement reference", "[sqnice]") {
+    sqnice::command& ins = db.cached_command("INSERT INTO contacts (name, phone) VALUES (?, ?)");
+    CHECK(&ins == &db.cached_command("INSERT INTO contacts (name, phone) VALUES (?, ?)"));
+    ins.execute("Mike", "555-1234");
+    db.cached_command("INSERT INTO contacts (name, phone) VALUES (?, ?)").execute("Jane", "555-4321");
+
+    string_view sql = "SELECT phone FROM contacts WHERE name = ?";
+    CHECK(db.cached_query(sql)("Jane").single_value<string>() == "555-4321");
+    CHECK(db.cached_query(sql)("Mike").single_value<string>() == "555-1234");
+    CHECK(db.query_cache_stats().hits == 1);
+    CHECK(db.command_cache_stats().hits == 2);
+}
+
+TEST_CASE_METHOD(sqnice_test, "SQNice nested cached queries", "[sqnice]") {
+    db.execute("INSERT INTO contacts (name, phone) VALUES ('Mike', '555-1234')");
+    db.execute("INSERT INTO contacts (name, phone) VALUES ('Jane', '555-4321')");
+
+    string_view sql = "SELECT name FROM contacts ORDER BY name";
+    int n = 0;
+    for (auto outer : db.query(sql)) {
+        for (auto inner : db.query(sql)) {
+            (void)outer; (void)inner;
+            ++n;
+        }
+    }
+    CHECK(n == 4);
+    auto stats = db.query_cache_stats();
+    CHECK(stats.count == 2);        // the nested loop needed a second instance
+    CHECK(stats.misses == 2);
+    CHECK(stats.hits == 1);
+
+    // Both instances are now idle, so this reuses one of them:
+    CHECK(db.query(sql).single_value<string>() == "Jane");
+    CHECK(db.query_cache_stats().count == 2);
+    CHECK(db.query_cache_stats().hits == 2);
+}
+
+namespace {
+    // Minimal coroutine type for testing `pool::borrow_async`.
+    struct detached_task {
+        struct promise_type {
+            detached_task get_return_object() noexcept              {return {};}
+            std::suspend_never initial_suspend() noexcept           {return {};}
+            std::suspend_never final_suspend() noexcept             {return {};}
+            void return_void() noexcept                             { }
+            void unhandled_exception() noexcept                     {std::terminate();}
+        };
+    };
+
+    detached_task read_name_async(sqnice::pool& pool, std::promise<string>& result) {
+        sqnice::borrowed_database db = co_await pool.borrow_async();
+        result.set_value(db->query("SELECT name FROM contacts").single_value_or<string>(""));
+    }
+}
+
+TEST_CASE("SQNice pool async", "[sqnice]") {
+    static constexpr string_view kDBPath = "sqnice_test.sqlite3";
+    sqnice::pool pool(kDBPath, sqnice::open_flags::delete_first | sqnice::open_flags::readwrite);
+    pool.set_capacity(2);   // just one read-only database
+    {
+        auto db = pool.borrow_writeable();
+        db->execute("CREATE TABLE contacts (id INTEGER PRIMARY KEY, name TEXT, phone TEXT)");
+        db->command("INSERT INTO contacts (name, phone) VALUES (?1, ?2)").execute("Bob", "555-1212");
+    }
+
+    auto rows = pool.async_query<int64_t, string>("SELECT id, phone FROM contacts WHERE name = ?",
+                                                  string("Bob")).get();
+    REQUIRE(rows.size() == 1);
+    CHECK(rows[0] == tuple<int64_t, string>{1, "555-1212"});
+
+    CHECK(pool.async_read([](sqnice::database const& db) {
+        return db.query("SELECT count(*) FROM contacts").single_value_or<int>(-1);
+    }).get() == 1);
+
+    CHECK_THROWS_AS(pool.async_read([](sqnice::database const& db) {
+        return db.query("SELECT nonexistent FROM contacts").single_value_or<int>(-1);
+    }).get(), std::invalid_argument);
+
+    // A coroutine waiting for a database is resumed when one is returned:
+    std::promise<string> result;
+    auto future = result.get_future();
+    {
+        auto db = pool.borrow();
+        read_name_async(pool, result);
+        CHECK(future.wait_for(chrono::milliseconds(50)) == std::future_status::timeout);
+    }
+    CHECK(future.get() == "Bob");
+}
+
+TEST_CASE("SQNice pool thread affinity", "[sqnice]") {
+    static constexpr string_view kDBPath = "sqnice_test.sqlite3";
+    sqnice::pool pool(kDBPath, sqnice::open_flags::delete_first | sqnice::open_flags::readwrite);
+    pool.borrow_writeable()->execute("CREATE TABLE contacts (id INTEGER PRIMARY KEY, name TEXT)");
+    pool.set_capacity(3);   // two read-only databases
+    pool.set_thread_affinity(true);
+    CHECK(pool.thread_affinity());
+
+    // A thread gets the same database back every time:
+    const sqnice::database* mine = pool.borrow().get();
+    CHECK(pool.borrowed_count() == 0);
+    for (int i = 0; i < 10; ++i)
+        CHECK(pool.borrow().get() == mine);
+
+    // Another thread gets a different one:
+    const sqnice::database* theirs = nullptr;
+    std::thread([&] {theirs = pool.borrow().get();}).join();
+    CHECK(theirs != nullptr);
+    CHECK(theirs != mine);
+    CHECK(pool.open_count() == 3);
+    CHECK(pool.borrowed_count() == 0);
+
+    {
+        // When no others are free, a thread takes one parked by another thread:
+        auto db1 = pool.borrow();
+        CHECK(db1.get() == mine);
+        auto db2 = pool.borrow();
+        CHECK(db2.get() == theirs);
+        CHECK(pool.try_borrow() == nullptr);
+        CHECK(pool.borrowed_count() == 2);
+
+        // A thread waiting for a database is woken when one is returned:
+        std::atomic<bool> got = false;
+        std::thread waiter([&] {
+            auto db = pool.borrow();
+            got = true;
+        });
+        std::this_thread::sleep_for(chrono::milliseconds(50));
+        CHECK(!got);
+        db1.reset();
+        waiter.join();
+        CHECK(got);
+    }
+    CHECK(pool.borrowed_count() == 0);
+
+    pool.set_capacity(2);
+    CHECK(pool.open_count() == 2);
+    pool.set_thread_affinity(false);
+    CHECK(pool.borrow() != nullptr);
+    CHECK(pool.borrowed_count() == 0);
+    pool.close_all();
+    CHECK(pool.open_count() == 0);
+}
+
+TEST_CASE("SQNice pool stats", "[sqnice]") {
+    static constexpr string_view kDBPath = "sqnice_test.sqlite3";
+    sqnice::pool pool(kDBPath, sqnice::open_flags::delete_first | sqnice::open_flags::readwrite);
+    pool.borrow_writeable()->execute("CREATE TABLE contacts (id INTEGER PRIMARY KEY, name TEXT)");
+    pool.set_capacity(3);   // two read-only databases
+    CHECK(pool.stats().readonly.wait.count() == 0);     // not collecting yet
+    pool.set_collect_stats(true);
+    CHECK(pool.collect_stats());
+
+    {
+        auto db1 = pool.borrow();
+        auto db2 = pool.borrow();
+        CHECK(pool.try_borrow() == nullptr);
+        auto w = pool.borrow_writeable();
+        CHECK(pool.try_borrow_writeable() == nullptr);
+
+        // A borrower that has to wait shows up in `peak_waiting` and the wait histogram:
+        std::thread waiter([&] {auto db = pool.borrow();});
+        std::this_thread::sleep_for(chrono::milliseconds(50));
+        db1.reset();
+        waiter.join();
+    }
+    CHECK(pool.async_read([](sqnice::database const&) {return 1;}).get() == 1);
+
+    sqnice::pool_stats stats = pool.stats();
+    CHECK(stats.capacity == 3);
+    CHECK(stats.open_count == 3);
+    CHECK(stats.borrowed_count == 0);
+    CHECK(stats.peak_borrowed == 3);
+    CHECK(stats.readonly.wait.count() == 4);
+    CHECK(stats.readonly.hold.count() == 4);
+    CHECK(stats.readonly.wait.max() >= chrono::milliseconds(40));
+    CHECK(stats.readonly.hold.max() >= chrono::milliseconds(40));
+    CHECK(stats.readonly.unavailable == 1);
+    CHECK(stats.readonly.failed == 0);
+    CHECK(stats.readonly.peak_borrowed == 2);
+    CHECK(stats.readonly.peak_waiting == 1);
+    CHECK(stats.writeable.wait.count() == 1);
+    CHECK(stats.writeable.hold.count() == 1);
+    CHECK(stats.writeable.unavailable == 1);
+    CHECK(stats.writeable.peak_borrowed == 1);
+    CHECK(stats.writeable.peak_waiting == 0);
+
+    // Resetting keeps the databases currently borrowed:
+    {
+        auto db = pool.borrow();
+        pool.reset_stats();
+        stats = pool.stats();
+        CHECK(stats.readonly.wait.count() == 0);
+        CHECK(stats.readonly.unavailable == 0);
+        CHECK(stats.readonly.peak_borrowed == 1);
+        CHECK(stats.peak_borrowed == 1);
+    }
+    stats = pool.stats();
+    CHECK(stats.readonly.hold.count() == 1);
+    CHECK(stats.readonly.peak_borrowed == 1);
+
+    pool.set_collect_stats(false);
+    pool.borrow();
+    CHECK(pool.stats().readonly.hold.count() == 1);
+    pool.close_all();
+}
+
+TEST_CASE("SQNice pool writer queue", "[sqnice]") {
+    static constexpr string_view kDBPath = "sqnice_test.sqlite3";
+    sqnice::pool pool(kDBPath, sqnice::open_flags::delete_first | sqnice::open_flags::readwrite);
+    using enum sqnice::write_priority;
+
+    vector<string> order;
+    vector<std::thread> writers;
+    {
+        auto db = pool.borrow_writeable();
+        // Queue up writers one at a time, so their arrival order is known:
+        for (auto [name, pri] : {pair{"batch1", batch}, {"inter1", interactive},
+                                 {"batch2", batch}, {"inter2", interactive}}) {
+            writers.emplace_back([&pool, &order, name, pri] {
+                auto db = pool.borrow_writeable(pri);
+                order.push_back(name);      // safe: only the writer thread gets here
+            });
+            std::this_thread::sleep_for(chrono::milliseconds(20));
+        }
+        CHECK(pool.try_borrow_writeable() == nullptr);
+    }
+    for (auto& t : writers)
+        t.join();
+    CHECK(order == vector<string>{"inter1", "inter2", "batch1", "batch2"});
+    CHECK(pool.borrowed_count() == 0);
+    CHECK(pool.try_borrow_writeable() != nullptr);
+    pool.close_all();
+}
+
+TEST_CASE("SQNice pool group commit", "[sqnice]") {
+    static constexpr string_view kDBPath = "sqnice_test.sqlite3";
+    sqnice::pool pool(kDBPath, sqnice::open_flags::delete_first | sqnice::open_flags::readwrite);
+    int commits = 0;
+    {
+        auto db = pool.borrow_writeable();
+        db->execute("CREATE TABLE items (x INTEGER)");
+        db->set_commit_handler([&] {++commits; return false;});
+    }
+    auto insert = [](sqnice::database& db, int x) {
+        db.command("INSERT INTO items (x) VALUES (?)").execute(x);
+    };
+
+    // A lone call commits by itself, and returns its function's result:
+    CHECK(pool.group_commit([&](sqnice::database& db) {insert(db, 0); return 17;}) == 17);
+    CHECK(commits == 1);
+
+    // Calls made while a group is being committed queue up, and commit together next:
+    std::promise<void> release;
+    std::shared_future<void> released = release.get_future().share();
+    std::atomic<bool> leading = false;
+    vector<std::thread> threads;
+    threads.emplace_back([&] {
+        pool.group_commit([&](sqnice::database& db) {
+            leading = true;
+            released.wait();
+            insert(db, 1);
+        });
+    });
+    while (!leading)
+        std::this_thread::sleep_for(chrono::milliseconds(1));
+    std::atomic<int> failed = 0;
+    for (int i = 2; i < 10; ++i) {
+        threads.emplace_back([&, i] {
+            try {
+                pool.group_commit([&](sqnice::database& db) {
+                    insert(db, i);
+                    if (i == 5)
+                        throw std::runtime_error("oops");
+                });
+            } catch (std::runtime_error const&) {
+                failed = i;
+            }
+        });
+    }
+    std::this_thread::sleep_for(chrono::milliseconds(50));
+    release.set_value();
+    for (auto& t : threads)
+        t.join();
+    CHECK(commits == 3);
+    CHECK(failed == 5);     // ...and only its insert was rolled back:
+    auto db = pool.borrow();
+    CHECK(db->query("SELECT group_concat(x) FROM (SELECT x FROM items ORDER BY x)")
+            .single_value<string>() == "0,1,2,3,4,6,7,8,9");
+    db.reset();
+
+    // If the commit fails, the caller gets the error:
+    pool.borrow_writeable()->set_commit_handler([] {return true;});     // true means "roll back"
+    CHECK_THROWS_AS(pool.group_commit([&](sqnice::database& db) {insert(db, 10);}),
+                    sqnice::database_error);
+    CHECK(pool.borrow()->query("SELECT count(*) FROM items WHERE x = 10").single_value<int>() == 0);
+    pool.borrow_writeable()->set_commit_handler(nullptr);
+    pool.group_commit([&](sqnice::database& db) {insert(db, 11);});
+    pool.close_all();
+}
+
+TEST_CASE("SQNice pool writer thread", "[sqnice]") {
+    static constexpr string_view kDBPath = "sqnice_test.sqlite3";
+    auto insert = [](sqnice::database& db, int x) {
+        db.command("INSERT INTO items (x) VALUES (?)").execute(x);
+    };
+    std::future<void> last;
+    {
+        sqnice::pool pool(kDBPath, sqnice::open_flags::delete_first | sqnice::open_flags::readwrite);
+        int commits = 0;
+        {
+            auto db = pool.borrow_writeable();
+            db->execute("CREATE TABLE items (x INTEGER)");
+            db->set_commit_handler([&] {++commits; return false;});
+        }
+
+        // The first async_write starts the writer thread; hold it up while more are queued:
+        std::promise<void> release;
+        std::shared_future<void> released = release.get_future().share();
+        std::atomic<bool> started = false;
+        auto first = pool.async_write([=, &started](sqnice::database& db) {
+            started = true;
+            released.wait();
+            insert(db, 0);
+            return std::this_thread::get_id();
+        });
+        while (!started)
+            std::this_thread::sleep_for(chrono::milliseconds(1));
+        vector<std::future<std::thread::id>> futures;
+        for (int i = 1; i < 10; ++i) {
+            futures.push_back(pool.async_write([=](sqnice::database& db) {
+                insert(db, i);
+                return std::this_thread::get_id();
+            }));
+        }
+        auto failure = pool.async_write([=](sqnice::database& db) {
+            insert(db, 99);
+            throw std::runtime_error("oops");
+        });
+        release.set_value();
+
+        // All writes ran on the writer thread, and the queued ones were committed together:
+        std::thread::id writer = first.get();
+        CHECK(writer != std::this_thread::get_id());
+        for (auto& f : futures)
+            CHECK(f.get() == writer);
+        CHECK_THROWS_AS(failure.get(), std::runtime_error);
+        CHECK(commits == 2);
+
+        // group_commit runs on the writer thread too, now that it's started:
+        CHECK(pool.group_commit([&](sqnice::database& db) {
+            insert(db, 10);
+            return std::this_thread::get_id();
+        }) == writer);
+        CHECK(pool.borrow()->query("SELECT sum(x) FROM items").single_value<int>() == 55);
+
+        // The writer thread keeps the writeable database until it's stopped:
+        CHECK(pool.try_borrow_writeable() == nullptr);
+        pool.stop_writer_thread();
+        CHECK(pool.try_borrow_writeable() != nullptr);
+
+        // Writes still queued when the pool is destructed are completed first:
+        last = pool.async_write([=](sqnice::database& db) {insert(db, 11);});
+    }
+    last.get();
+    sqnice::database db(kDBPath, sqnice::open_flags::readonly);
+    CHECK(db.query("SELECT count(*) FROM items").single_value<int>() == 12);
+}
+
+TEST_CASE_METHOD(sqnice_test, "SQNice profile handler", "[sqnice]") {
+    vector<pair<string, string>> profiled;
+    db.set_profile_handler([&](sqnice::statement_profile const& prof) {
+        CHECK(prof.duration.count() >= 0);
+        profiled.emplace_back(prof.sql(), prof.expanded_sql());
+    });
+    db.command("INSERT INTO contacts (name, phone) VALUES (?, ?)").execute("Bob", "555-1212");
+    CHECK(db.query("SELECT count(*) FROM contacts").single_value<int>() == 1);
+    db.set_profile_handler(nullptr);
+    db.execute("DELETE FROM contacts");
+
+    REQUIRE(profiled.size() == 2);
+    CHECK(profiled[0].first == "INSERT INTO contacts (name, phone) VALUES (?, ?)");
+    CHECK(profiled[0].second == "INSERT INTO contacts (name, phone) VALUES ('Bob', '555-1212')");
+    CHECK(profiled[1].first == "SELECT count(*) FROM contacts");
+
+    // The handler survives moving the database:
+    sqnice::database temp;
+    temp.open_temporary();
+    int calls = 0;
+    temp.set_profile_handler([&](sqnice::statement_profile const& prof) {
+        CHECK(prof.start <= chrono::steady_clock::now());
+        ++calls;
+    });
+    sqnice::database moved(std::move(temp));
+    CHECK(moved.query("SELECT 17").single_value<int>() == 17);
+    temp = std::move(moved);
+    CHECK(temp.query("SELECT 18").single_value<int>() == 18);
+    CHECK(calls == 2);
+}
+
+TEST_CASE("SQNice latency histogram", "[sqnice]") {
+    using namespace std::chrono;
+    sqnice::latency_histogram h;
+    CHECK(h.percentile(0.5) == 0ns);
+    for (int i = 1; i <= 1000; ++i)
+        h.record(microseconds(i));
+    CHECK(h.count() == 1000);
+    CHECK(h.max() == 1000us);
+    CHECK(h.mean() == 500500ns);
+    auto p50 = h.percentile(0.5), p99 = h.percentile(0.99);
+    CHECK(p50 >= 500us);
+    CHECK(p50 <= 625us);            // within 25%
+    CHECK(p99 >= 990us);
+    CHECK(p99 <= 1000us);           // clamped to the max
+    CHECK(h.percentile(1.0) == 1000us);
+
+    sqnice::latency_histogram h2;
+    h2.record(5ms);
+    h.merge(h2);
+    CHECK(h.count() == 1001);
+    CHECK(h.max() == 5ms);
+    h.reset();
+    CHECK(h.count() == 0);
+    CHECK(h.max() == 0ns);
+}
+
+TEST_CASE("SQNice normalize SQL", "[sqnice]") {
+    using sqnice::slow_query_log;
+    CHECK(slow_query_log::normalize_sql("SELECT *  FROM t\n WHERE id = 17 AND name='O''Brien'")
+          == "SELECT * FROM t WHERE id = ? AND name=?");
+    CHECK(slow_query_log::normalize_sql("select x'0A1B', 1.5e-3, .25, t2.c3 from t2")
+          == "select ?, ?, ?, t2.c3 from t2");
+    CHECK(slow_query_log::normalize_sql("UPDATE \"table 1\" SET a = :a, b = ?2 WHERE c = $c")
+          == "UPDATE \"table 1\" SET a = ?, b = ? WHERE c = ?");
+}
+
+TEST_CASE_METHOD(sqnice_test, "SQNice slow query log", "[sqnice]") {
+    using namespace std::chrono;
+    sqnice::slow_query_log log(1h);
+    log.attach(db);
+    for (int i = 0; i < 10; ++i)
+        db.execute(sqnice::format("INSERT INTO contacts (name, phone) VALUES ('n%d', '%d')", i, i));
+    CHECK(db.query("SELECT id FROM contacts WHERE phone = ?")("5").single_value<int>() == 6);
+    CHECK(log.slow_queries().empty());
+
+    log.set_threshold(0ns);     // everything is slow now
+    CHECK(db.query("SELECT id FROM contacts WHERE phone = ?")("7").single_value<int>() == 8);
+    CHECK(db.query("SELECT id FROM contacts WHERE phone = ?")("8").single_value<int>() == 9);
+
+    auto slow = log.slow_queries();
+    REQUIRE(slow.size() == 2);
+    CHECK(slow[0].sql == "SELECT id FROM contacts WHERE phone = '7'");
+    CHECK(slow[1].sql == "SELECT id FROM contacts WHERE phone = '8'");
+
+    auto shapes = log.shapes();
+    REQUIRE(shapes.size() == 2);
+    for (auto& shape : shapes) {
+        if (shape.shape.starts_with("INSERT")) {
+            CHECK(shape.shape == "INSERT INTO contacts (name, phone) VALUES (?, ?)");
+            CHECK(shape.count == 10);
+            CHECK(shape.slow_count == 0);
+            CHECK(shape.plan.empty());
+        } else {
+            CHECK(shape.shape == "SELECT id FROM contacts WHERE phone = ?");
+            CHECK(shape.count == 3);
+            CHECK(shape.slow_count == 2);
+            CHECK(shape.max >= shape.p50);
+            CHECK(shape.plan.find("SCAN contacts") != string::npos);
+        }
+    }
+
+    log.clear();
+    CHECK(log.shapes().empty());
+
+    // Attaching another log doesn't detach the first:
+    sqnice::slow_query_log log2(1h);
+    log2.attach(db);
+    CHECK(db.query("SELECT count(*) FROM contacts").single_value<int>() == 10);
+    CHECK(log.shapes().size() == 1);
+    CHECK(log2.shapes().size() == 1);
+    db.set_profile_handler(nullptr);
+    CHECK(!db.get_profile_handler());
+}
+
+TEST_CASE("SQNice workload recorder", "[sqnice]") {
+    static constexpr string_view kDBPath = "sqnice_test.sqlite3";
+    static constexpr const char* kLogPath = "sqnice_test.workload";
+    static constexpr string_view kCopyPaths[2] = {"sqnice_test_copy1.sqlite3",
+                                                  "sqnice_test_copy2.sqlite3"};
+    using enum sqnice::open_flags;
+    sqnice::database db(kDBPath, delete_first | readwrite | create);
+    db.execute("CREATE TABLE items (id INTEGER PRIMARY KEY, name TEXT, score REAL, data BLOB)");
+    for (auto path : kCopyPaths) {
+        sqnice::database copy(path, delete_first | readwrite | create);
+        db.backup(copy);
+    }
+
+    {
+        sqnice::workload_recorder recorder(kLogPath);
+        sqnice::database db2(kDBPath, readwrite);
+        CHECK(recorder.attach(db) == 1);
+        CHECK(recorder.attach(db2) == 2);
+
+        sqnice::transaction txn(db);
+        auto ins = db.command("INSERT INTO items (id, name, score, data) VALUES (?, ?, ?, ?)");
+        ins.execute(1, "it's one", 1.5, sqnice::blob("\x01\xff", 2));
+        ins.execute(2, nullptr, -2.25, nullptr);
+        txn.commit();
+
+        auto upd = db2.command("UPDATE items SET name = :name WHERE id = :id OR id = :id + 100");
+        upd.bind(":name", "two");
+        upd.bind(":id", 2);
+        upd.execute();
+        CHECK(db2.query("SELECT name FROM items WHERE id = ?1 AND '?' != ?1")(1)
+                  .single_value<string>() == "it's one");
+
+        // A REAL is recorded exactly, and a pointer can't be recorded at all:
+        db2.command("UPDATE items SET score = ? WHERE id = 1").execute(0.1 + 0.2);
+        int pointee = 0;
+        auto ptr = db2.query("SELECT ?1 IS NULL");
+        ptr.bind_pointer(1, &pointee, "sqnice_test", nullptr);
+        CHECK(ptr.single_value<bool>());
+
+        db.set_profile_handler(nullptr);
+        db2.set_profile_handler(nullptr);
+        CHECK(recorder.event_count() >= 8);
+    }
+
+    // Read the log back:
+    using namespace sqnice;
+    size_t n_events = 0, n_inserts = 0;
+    bool began = false, committed = false, updated = false, exact = false, unreplayable = false;
+    {
+        workload_reader reader(kLogPath);
+        workload_event e;
+        chrono::nanoseconds last_end {};
+        while (reader.next(e)) {
+            CHECK(e.sequence == n_events);
+            ++n_events;
+            CHECK(e.duration.count() >= 0);
+            CHECK(e.start + e.duration >= last_end);    // events are in the order they ended
+            last_end = e.start + e.duration;
+            if (e.sql.starts_with("BEGIN"))
+                began = (e.connection == 1);
+            else if (e.sql == "COMMIT")
+                committed = (e.connection == 1);
+            else if (e.sql.starts_with("INSERT")) {
+                CHECK(e.connection == 1);
+                REQUIRE(e.params.size() == 4);
+                if (n_inserts++ == 0) {
+                    CHECK(e.params[0] == workload_value(int64_t(1)));
+                    CHECK(e.params[1] == workload_value(string("it's one")));
+                    CHECK(e.params[2] == workload_value(1.5));
+                    CHECK(e.params[3] == workload_value(vector<byte>{byte(0x01), byte(0xff)}));
+                } else {
+                    CHECK(e.params[0] == workload_value(int64_t(2)));
+                    CHECK(e.params[1] == workload_value(nullptr));
+                    CHECK(e.params[2] == workload_value(-2.25));
+                    CHECK(e.params[3] == workload_value(nullptr));
+                }
+            } else if (e.sql.starts_with("UPDATE items SET score")) {
+                exact = (e.params == vector<workload_value>{0.1 + 0.2});
+            } else if (e.sql.starts_with("UPDATE")) {
+                updated = true;
+                CHECK(e.connection == 2);
+                REQUIRE(e.params.size() == 2);
+                CHECK(e.params[0] == workload_value(string("two")));
+                CHECK(e.params[1] == workload_value(int64_t(2)));
+            } else if (e.sql == "SELECT ?1 IS NULL") {
+                unreplayable = !e.replayable;
+                CHECK(e.params.empty());
+            } else if (e.sql.starts_with("SELECT")) {
+                CHECK(e.replayable);
+                REQUIRE(e.params.size() == 1);
+                CHECK(e.params[0] == workload_value(int64_t(1)));
+            }
+        }
+    }
+    CHECK(n_inserts == 2);
+    CHECK((began && committed && updated && exact && unreplayable));
+
+    // Replay it, both ways, and check that the copies end up the same as the original. (With
+    // `original_timing` the UPDATE still waits for the COMMIT, since it began after that ended.)
+    auto contents = [](sqnice::database const& d) {
+        vector<string> rows;
+        for (auto row : d.query("SELECT id, name, score, hex(data) FROM items ORDER BY id"))
+            rows.push_back(row.get<string>(0) + "|" + row.get<string>(1) + "|"
+                           + row.get<string>(2) + "|" + row.get<string>(3));
+        return rows;
+    };
+    CHECK(contents(db).size() == 2);
+    for (int i = 0; i < 2; ++i) {
+        replay_options options;
+        options.original_timing = (i == 1);
+        size_t replayed = 0;
+        options.on_statement = [&](workload_event const&, chrono::nanoseconds, status rc) {
+            CHECK(rc == status::ok);
+            ++replayed;
+        };
+        replay_result result = replay_workload(kLogPath, kCopyPaths[i], options);
+        CHECK(result.statements == n_events - 1);
+        CHECK(result.errors == 0);
+        CHECK(result.skipped == 1);
+        CHECK(replayed == n_events - 1);
+        sqnice::database copy(kCopyPaths[i], readwrite);
+        CHECK(contents(copy) == contents(db));
+        copy.close_and_delete();
+    }
+    std::remove(kLogPath);
+}
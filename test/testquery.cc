@@ -1,4 +1,5 @@
 #include "sqnice_test.hh"
+#include <ranges>
 
 using namespace std;
 
@@ -210,3 +211,458 @@ TEST_CASE_METHOD(sqnice_test, "SQNice select", "[.sqnice]") {
         cout << id << "\t" << name << "\t" << phone << endl;
     }
 }
+
+
+static_assert(sqnice::count_sql_parameters("SELECT 1") == 0);
+static_assert(sqnice::count_sql_parameters("SELECT ?, ?") == 2);
+static_assert(sqnice::count_sql_parameters("SELECT ?3, ?") == 4);
+static_assert(sqnice::count_sql_parameters("SELECT :a, :b, :a, @c") == 3);
+static_assert(sqnice::count_sql_parameters("SELECT '?', \"?\" -- ?\n, ? /* ? */") == 1);
+
+TEST_CASE_METHOD(sqnice_test, "SQNice literal statements", "[sqnice]") {
+    auto& ins = db.command<"INSERT INTO contacts (name, phone) VALUES (?, ?)">("Mike", "555-1234");
+    ins.execute();
+    CHECK(&ins == &db.command<"INSERT INTO contacts (name, phone) VALUES (?, ?)">());
+    db.command<"INSERT INTO contacts (name, phone) VALUES (?, ?)">("Jane", "555-4321").execute();
+
+    CHECK(db.query<"SELECT count(*) FROM contacts">().single_value<int>() == 2);
+    CHECK(db.query<"SELECT phone FROM contacts WHERE name = :name">("Jane")
+            .single_value<string>() == "555-4321");
+    int n = 0;
+    for (auto row : db.query<"SELECT name FROM contacts ORDER BY name">()) {
+        CHECK(string(row.get<const char*>(0)) == (n == 0 ? "Jane" : "Mike"));
+        ++n;
+    }
+    CHECK(n == 2);
+    // Literal statements don't go through the regular caches:
+    CHECK(db.query_cache_stats().misses == 0);
+
+    // Nested iterations of the same literal query work, using the regular cache:
+    vector<string> pairs;
+    for (auto row1 : db.query<"SELECT name FROM contacts ORDER BY name">()) {
+        for (auto row2 : db.query<"SELECT name FROM contacts ORDER BY name">())
+            pairs.push_back(row1.get<string>(0) + "+" + row2.get<string>(0));
+    }
+    CHECK(pairs == vector<string>{"Jane+Jane", "Jane+Mike", "Mike+Jane", "Mike+Mike"});
+    CHECK(db.query_cache_stats().count == 1);
+}
+
+struct contact { string name, phone; };
+namespace sqnice {
+    inline status bind_row_helper(statement& stmt, contact const& c) {
+        stmt.bind(1, uncopied(c.name));
+        return stmt.bind(2, uncopied(c.phone));
+    }
+}
+
+TEST_CASE_METHOD(sqnice_test, "SQNice execute_many", "[sqnice]") {
+    sqnice::command cmd(db, "INSERT INTO contacts (name, phone) VALUES (?, ?)");
+    vector<tuple<string, const char*>> rows {
+        {"Mike", "555-1234"}, {"Janette", "555-4321"}, {"Dave", "555-0000"}};
+    vector<int64_t> rowids;
+    cmd.execute_many(rows, &rowids);
+    CHECK(cmd.changes() == 3);
+    CHECK(rowids == vector<int64_t>{1, 2, 3});
+    CHECK(cmd.last_insert_rowid() == 3);
+    CHECK(!db.in_transaction());
+
+    vector<contact> contacts {{"Alice", "555-1111"}, {"Bob", "555-2222"}};
+    cmd.execute_many(contacts);
+    CHECK(cmd.changes() == 2);
+    CHECK(db.query("SELECT phone FROM contacts WHERE name = 'Bob'").single_value<string>()
+          == "555-2222");
+
+    // A failure rolls back the whole batch, even inside a transaction:
+    sqnice::transaction txn(db);
+    vector<pair<const char*, const char*>> bad {{"Eve", "555-3333"}, {"Mallory", nullptr}};
+    CHECK_THROWS_WITH(cmd.execute_many(bad), "NOT NULL constraint failed: contacts.phone");
+    CHECK(db.in_transaction());
+    txn.commit();
+    CHECK(db.query("SELECT count(*) FROM contacts").single_value<int>() == 5);
+
+    // An exception from the row source is rethrown as-is, after the batch is rolled back:
+    auto throwing = std::views::iota(0, 3) | std::views::transform([](int i) {
+        if (i == 2)
+            throw std::runtime_error("row source failed");
+        return tuple{"Trent", i};
+    });
+    CHECK_THROWS_WITH(cmd.execute_many(throwing), "row source failed");
+    CHECK(!db.in_transaction());
+    CHECK(db.query("SELECT count(*) FROM contacts").single_value<int>() == 5);
+}
+
+TEST_CASE_METHOD(sqnice_test, "SQNice bulk_inserter", "[sqnice]") {
+    db.set_limit(sqnice::limit::variables, 10);
+    sqnice::bulk_inserter<string, string> ins(db, "contacts", {"name", "phone"},
+                                              "ON CONFLICT DO NOTHING");
+    CHECK(ins.rows_per_chunk() == 5);
+    {
+        sqnice::transaction txn(db);
+        auto cached_commands = db.command_cache_stats().count;
+        for (int i = 0; i < 12; ++i)
+            ins.insert("name " + to_string(i), "555-" + to_string(1000 + i));
+        CHECK(ins.pending() == 2);
+        CHECK(ins.stats().statements == 2);
+        ins.insert_all(vector<tuple<const char*, const char*>>{{"name 0", "555-1000"}});
+        ins.flush();
+        // Partial chunks don't use (and crowd) the database's statement cache:
+        CHECK(db.command_cache_stats().count == cached_commands);
+        txn.commit();
+    }
+    CHECK(ins.pending() == 0);
+    auto& stats = ins.stats();
+    CHECK(stats.rows == 13);
+    CHECK(stats.statements == 3);
+    CHECK(stats.changes == 12);     // the duplicate row was ignored
+    CHECK(db.query("SELECT count(*) FROM contacts").single_value<int>() == 12);
+    CHECK(db.query("SELECT phone FROM contacts WHERE name = 'name 11'").single_value<string>()
+          == "555-1011");
+
+    CHECK_THROWS_AS((sqnice::bulk_inserter<int>(db, "contacts", {"name", "phone"})),
+                    std::invalid_argument);
+
+    // A failed chunk is discarded, and the inserter can keep going:
+    sqnice::bulk_inserter<string, optional<string>> ins2(db, "contacts", {"name", "phone"});
+    for (int i = 0; i < 4; ++i)
+        CHECK(ins2.insert("bad " + to_string(i), "555-" + to_string(2000 + i)) == sqnice::status::ok);
+    CHECK_THROWS_WITH(ins2.insert("bad 4", nullopt),
+                      "NOT NULL constraint failed: contacts.phone");
+    CHECK(ins2.pending() == 0);
+    for (int i = 0; i < 6; ++i)
+        CHECK(ins2.insert("good " + to_string(i), "555-" + to_string(3000 + i)) == sqnice::status::ok);
+    CHECK(ins2.pending() == 1);
+    CHECK(ins2.flush() == sqnice::status::ok);
+    CHECK(db.query("SELECT count(*) FROM contacts").single_value<int>() == 18);
+    CHECK(db.query("SELECT count(*) FROM contacts WHERE name LIKE 'bad%'")
+              .single_value<int>() == 0);
+}
+
+TEST_CASE_METHOD(sqnice_test, "SQNice typed rows", "[sqnice]") {
+    db.execute("INSERT INTO contacts (name, phone) VALUES ('Mike', '555-1234')");
+    db.execute("INSERT INTO contacts (name, phone, address) VALUES ('Jane', '555-4321', 'Here')");
+
+    sqnice::query qry(db, "SELECT id, name, address FROM contacts ORDER BY id");
+    int n = 0;
+    for (auto [id, name, address] : qry.as<int64_t, string_view, optional<string>>()) {
+        ++n;
+        CHECK(id == n);
+        CHECK(name == (n == 1 ? "Mike" : "Jane"));
+        CHECK(address == (n == 1 ? nullopt : optional<string>("Here")));
+    }
+    CHECK(n == 2);
+
+    // Iterating an rvalue query:
+    n = 0;
+    for (auto [name] : db.query("SELECT name FROM contacts WHERE phone = ?")("555-1234")
+                         .as<string>()) {
+        CHECK(name == "Mike");
+        ++n;
+    }
+    CHECK(n == 1);
+
+    CHECK_THROWS_AS((qry.as<int, int, int, int>().begin()), std::invalid_argument);
+}
+
+TEST_CASE_METHOD(sqnice_test, "SQNice column batch", "[sqnice]") {
+    sqnice::bulk_inserter<string, string, optional<string>> ins(db, "contacts",
+                                                                {"name", "phone", "address"});
+    for (int i = 0; i < 100; ++i)
+        ins.insert("name " + to_string(i), "555-" + to_string(1000 + i),
+                   (i % 3) ? optional<string>("addr " + to_string(i)) : nullopt);
+    ins.flush();
+
+    sqnice::query qry(db, "SELECT id, name, address, id * 0.5 FROM contacts ORDER BY id");
+    sqnice::column_batch batch;
+    auto iter = qry.begin();
+    size_t total = 0;
+    for (size_t n; (n = iter.fetch_columns(batch, 30)) > 0; total += n) {
+        REQUIRE(batch.row_count() == n);
+        REQUIRE(batch.column_count() == 4);
+        auto& ids = batch[0], &names = batch[1], &addrs = batch[2], &halves = batch[3];
+        CHECK(ids.type() == sqnice::data_type::integer);
+        CHECK(names.type() == sqnice::data_type::text);
+        CHECK(addrs.type() == sqnice::data_type::text);
+        CHECK(halves.type() == sqnice::data_type::floating_point);
+        for (size_t r = 0; r < n; ++r) {
+            size_t i = total + r;
+            CHECK(ids.integers()[r] == int64_t(i + 1));
+            CHECK(names.text(r) == "name " + to_string(i));
+            CHECK(addrs.is_null(r) == (i % 3 == 0));
+            if (i % 3)
+                CHECK(addrs.text(r) == "addr " + to_string(i));
+            CHECK(halves.doubles()[r] == (i + 1) * 0.5);
+        }
+    }
+    CHECK(total == 100);
+    CHECK(batch.row_count() == 0);
+
+    CHECK(qry.fetch_columns(batch, 5) == 5);
+    CHECK(batch[1].text(4) == "name 4");
+}
+
+TEST_CASE_METHOD(sqnice_test, "SQNice pmr columns", "[sqnice]") {
+    db.execute("INSERT INTO contacts (name, phone, address) VALUES "
+               "('Mike', '555-1234', NULL), ('Jane', '555-4321', x'CAFEBABE')");
+    char buffer[1024];
+    std::pmr::monotonic_buffer_resource arena(buffer, sizeof(buffer),
+                                              std::pmr::null_memory_resource());
+    sqnice::query qry(db, "SELECT name, address FROM contacts ORDER BY id");
+    std::pmr::vector<std::tuple<std::pmr::string, optional<std::pmr::vector<std::byte>>>> rows(&arena);
+    for (auto&& row : qry.as<std::pmr::string, optional<std::pmr::vector<std::byte>>>(arena))
+        rows.push_back(std::move(row));
+    REQUIRE(rows.size() == 2);
+    CHECK(get<0>(rows[0]) == "Mike");
+    CHECK(get<0>(rows[0]).get_allocator().resource() == &arena);
+    CHECK(!get<1>(rows[0]));
+    CHECK(get<0>(rows[1]) == "Jane");
+    REQUIRE(get<1>(rows[1]));
+    CHECK(get<1>(rows[1])->size() == 4);
+    CHECK(get<1>(rows[1])->get_allocator().resource() == &arena);
+
+    auto name = (*qry.begin()).get<std::pmr::string>(0, arena);
+    CHECK(name == "Mike");
+}
+
+TEST_CASE_METHOD(sqnice_test, "SQNice parameter names", "[sqnice]") {
+    static const sqnice::parameter_names kNames {":phone", ":user"};
+    string_view sql = "INSERT INTO contacts (name, phone) VALUES (:user, :phone)";
+    const int* indexes;
+    {
+        sqnice::command cmd = db.command(sql);
+        indexes = cmd.parameter_indexes(kNames).data();
+        CHECK(indexes[0] == 2);
+        CHECK(indexes[1] == 1);
+        cmd.bind(kNames, "555-1234", "Mike");
+        cmd.execute();
+    }
+
+    // The resolved indexes are remembered by the cached statement:
+    sqnice::command cmd2 = db.command(sql);
+    CHECK(cmd2.parameter_indexes(kNames).data() == indexes);
+
+    static const sqnice::parameter_map kContact {
+        sqnice::param(":user",  &contact::name),
+        sqnice::param(":phone", &contact::phone) };
+    cmd2.bind(kContact, contact{"Jane", "555-4321"});
+    cmd2.execute();
+    CHECK(db.query("SELECT name FROM contacts WHERE phone = '555-4321'").single_value<string>()
+          == "Jane");
+
+    static const sqnice::parameter_names kBadNames {":user", ":nope"};
+    CHECK_THROWS_AS(cmd2.bind(kBadNames, "x", "y"), std::invalid_argument);
+}
+
+TEST_CASE_METHOD(sqnice_test, "SQNice fast handle", "[sqnice]") {
+    sqnice::command cmd(db, "INSERT INTO contacts (name, phone) VALUES (?, ?)");
+    {
+        auto fast = cmd.fast();
+        for (int i = 0; i < 10; ++i) {
+            string name = "name " + to_string(i);
+            CHECK(fast.bind(1, name) == sqnice::status::ok);
+            CHECK(fast.bind(2, "555-1234") == sqnice::status::ok);
+            CHECK(fast.execute() == sqnice::status::ok);
+            CHECK(fast.last_insert_rowid() == i + 1);
+        }
+        CHECK_THROWS_AS(cmd.bind(1, "x"), std::logic_error);  // in use by the handle
+        CHECK(basic_status(fast.execute()) == sqnice::status::constraint);
+    }
+
+    sqnice::query qry(db, "SELECT id, name FROM contacts WHERE id >= ? ORDER BY id");
+    auto fast = qry.fast();
+    fast.bind(1, 9);
+    CHECK(fast.step() == sqnice::status::row);
+    CHECK(fast.column_count() == 2);
+    CHECK(fast.column_int64(0) == 9);
+    CHECK(fast.column_text(1) == "name 8");
+    CHECK(fast.step() == sqnice::status::row);
+    CHECK(fast.column_int(0) == 10);
+    CHECK(fast.step() == sqnice::status::done);
+
+    // The handle's uncopied string bindings don't outlive it:
+    sqnice::query& cached = db.cached_query("SELECT ?1 IS NULL");
+    {
+        auto fast2 = cached.fast();
+        string temp = "temporary";
+        CHECK(fast2.bind(1, temp) == sqnice::status::ok);
+        CHECK(fast2.step() == sqnice::status::row);
+    }
+    CHECK(cached.single_value<bool>() == true);
+}
+
+TEST_CASE_METHOD(sqnice_test, "SQNice row stream", "[sqnice]") {
+    {
+        sqnice::bulk_inserter<string, string> ins(db, "contacts", {"name", "phone"});
+        sqnice::transaction txn(db);
+        for (int i = 1; i <= 1000; ++i)
+            ins.insert("name " + to_string(i), "555-" + to_string(i));
+        ins.flush();
+        txn.commit();
+    }
+
+    sqnice::query qry(db, "SELECT id, name FROM contacts WHERE id >= ? ORDER BY id");
+    qry.bind(1, 1);
+    int64_t n = 0;
+    {
+        sqnice::row_stream<int64_t, string> rows(qry, 16, 2);
+        CHECK_THROWS_AS(qry.begin(), std::logic_error);    // the stream owns the statement
+        for (auto& [id, name] : rows) {
+            ++n;
+            CHECK(id == n);
+            CHECK(std::move(name) == "name " + to_string(n));
+        }
+        CHECK(rows.last_status() == sqnice::status::done);
+        CHECK_THROWS_AS(rows.begin(), std::logic_error);
+    }
+    CHECK(n == 1000);
+
+    // Stopping early cancels the producer and resets the query:
+    {
+        sqnice::row_stream<int64_t, string> rows(qry, 8, 3);
+        n = 0;
+        for (auto& row : rows) {
+            if (++n == 20)
+                break;
+            CHECK(std::get<0>(row) == n);
+        }
+    }
+    CHECK(n == 20);
+    CHECK(qry.begin()->get<int64_t>(0) == 1);
+
+    // An empty result:
+    qry.bind(1, 5000);
+    sqnice::row_stream<int64_t> empty(qry);
+    CHECK(empty.begin() == empty.end());
+
+    CHECK_THROWS_AS((sqnice::row_stream<int, int, int>(qry)), std::invalid_argument);
+}
+
+TEST_CASE_METHOD(sqnice_test, "SQNice statement stats", "[sqnice]") {
+    for (int i = 0; i < 20; ++i)
+        db.command("INSERT INTO contacts (name, phone) VALUES (?, ?)")
+            .execute("name " + to_string(i), "555-" + to_string(i));
+
+    // No index on `phone`, so this scans the table and sorts:
+    auto& scan = db.cached_query("SELECT id FROM contacts WHERE phone > ? ORDER BY phone");
+    scan.bind(1, "555-1");
+    int n = 0;
+    for (auto row : scan)
+        n += (row[0].get<int>() > 0);
+    CHECK(n == 18);
+    sqnice::statement_stats stats = scan.stats();
+    CHECK(stats.fullscan_steps >= 19);
+    CHECK(stats.sorts == 1);
+    CHECK(stats.runs == 1);
+    CHECK(stats.vm_steps > 0);
+    CHECK(stats.memory_used > 0);
+
+    // A primary key lookup doesn't:
+    CHECK(db.query("SELECT name FROM contacts WHERE id = ?")(5).single_value<string>() == "name 4");
+
+    auto report = db.statement_report(true);
+    REQUIRE(report.size() == 3);
+    CHECK(report[0].sql == "INSERT INTO contacts (name, phone) VALUES (?, ?)");  // most VM steps
+    CHECK(report[0].instances == 1);
+    CHECK(report[0].stats.runs == 20);
+    for (auto& entry : report) {
+        if (entry.sql.starts_with("SELECT id"))
+            CHECK(entry.stats.fullscan_steps == stats.fullscan_steps);
+        else
+            CHECK(entry.stats.fullscan_steps == 0);
+    }
+
+    // The counters were reset by the report:
+    CHECK(scan.stats().vm_steps == 0);
+    CHECK(db.statement_report()[0].stats.runs == 0);
+}
+
+TEST_CASE_METHOD(sqnice_test, "SQNice query plan", "[sqnice]") {
+    using op = sqnice::query_plan::op;
+    sqnice::query byName(db, "SELECT id FROM contacts WHERE name = ?");
+    auto plan = byName.plan();
+    REQUIRE(plan.nodes().size() == 1);
+    auto& node = plan.nodes()[0];
+    CHECK(node.kind() == op::search);
+    CHECK(node.table() == "contacts");
+    CHECK(node.index() == "sqlite_autoindex_contacts_1");
+    CHECK(!plan.has_full_scan());
+    CHECK(plan.uses_index("contacts", "sqlite_autoindex_contacts_1"));
+    CHECK(plan.to_string() == node.detail + "\n");
+
+    plan = sqnice::query(db, "SELECT name FROM contacts WHERE id = ?").plan();
+    CHECK(plan.nodes().at(0).index() == "INTEGER PRIMARY KEY");
+    CHECK(!plan.has_full_scan());
+
+    plan = sqnice::query(db, "SELECT id FROM contacts WHERE phone > ? ORDER BY phone").plan();
+    CHECK(plan.has_full_scan());
+    REQUIRE(plan.full_scans().size() == 1);
+    CHECK(plan.full_scans()[0]->table() == "contacts");
+
+    plan = sqnice::command(db, "UPDATE contacts SET address = ? WHERE phone = ?").plan();
+    CHECK(plan.has_full_scan());
+
+    plan = sqnice::query(db, "SELECT name FROM contacts UNION SELECT address FROM contacts "
+                             "ORDER BY 1").plan();
+    CHECK(plan.nodes().at(0).kind() == op::compound);
+    CHECK(plan.uses_temp_btree());
+
+    // A join on an unindexed column makes SQLite build an automatic index:
+    plan = sqnice::query(db, "SELECT * FROM contacts a, contacts b WHERE a.phone = b.address")
+                .plan();
+    CHECK(plan.uses_automatic_index());
+    CHECK(plan.full_scans().size() == 1);
+
+    // A tree with a subquery:
+    plan = sqnice::query(db, "SELECT * FROM contacts WHERE id IN "
+                             "(SELECT id FROM contacts WHERE phone > 'x')").plan();
+    auto top = plan.children();
+    REQUIRE(top.size() == 2);
+    CHECK(top[1]->kind() == op::subquery);
+    auto sub = plan.children(top[1]->id);
+    REQUIRE(sub.size() == 1);
+    CHECK(sub[0]->kind() == op::scan);
+    CHECK(sub[0]->index() == "sqlite_autoindex_contacts_1");
+    CHECK(sub[0]->is_full_scan());      // scans the entire index
+    CHECK(plan.to_string().find("\n  SCAN contacts USING COVERING INDEX") != string::npos);
+
+    CHECK_THROWS_AS(sqnice::query_plan(db, "SELECT nothing FROM nowhere"), std::invalid_argument);
+}
+
+
+#ifdef SQNICE_ENABLE_SCANSTATUS
+TEST_CASE_METHOD(sqnice_test, "SQNice scan stats", "[sqnice]") {
+    {
+        sqnice::command ins(db, "INSERT INTO contacts (name, phone) VALUES (?, ?)");
+        for (int i = 0; i < 100; ++i)
+            ins.execute("name" + std::to_string(i), std::to_string(i % 10));
+    }
+    sqnice::query q(db, "SELECT a.name FROM contacts a, contacts b "
+                        "WHERE a.phone = '3' AND b.id = a.id");
+    int n = 0;
+    for (auto row : q) {
+        (void)row;
+        ++n;
+    }
+    CHECK(n == 10);
+
+    auto stats = q.scan_stats();
+    auto plan = q.plan();
+    // The stats line up with the plan nodes:
+    REQUIRE(stats.size() == plan.nodes().size());
+    for (size_t i = 0; i < stats.size(); ++i) {
+        CHECK(stats[i].node.id == plan.nodes()[i].id);
+        CHECK(stats[i].node.detail == plan.nodes()[i].detail);
+    }
+    // The outer loop scans all 100 rows once; the inner loop runs once per matching row:
+    CHECK(stats[0].node.is_full_scan());
+    CHECK(stats[0].name == stats[0].node.index());     // scans a covering index
+    CHECK(stats[0].loops == 1);
+    CHECK(stats[0].rows_visited == 100);
+    CHECK(stats[1].node.kind() == sqnice::query_plan::op::search);
+    CHECK(stats[1].loops == 10);
+    CHECK(stats[1].rows_visited == 10);
+    CHECK(stats[1].estimated_rows > 0);
+
+    q.reset_scan_stats();
+    CHECK(q.scan_stats()[0].loops == 0);
+}
+#endif